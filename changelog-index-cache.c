@@ -0,0 +1,269 @@
+/* changelog-index-cache - reuse the indexes of ChangeLog files.
+   Copyright (C) 2008-2010 Bruno Haible <bruno@clisp.org>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+
+/* Specification.  */
+#include "changelog-index-cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if HAVE_MMAP
+# include <sys/mman.h>
+#endif
+
+#include "error.h"
+#include "read-file.h"
+#include "sha1.h"
+#include "xalloc.h"
+
+/* The header of a cache file.  It is followed by the array of entry ends
+   and by the array of sketches.  */
+struct index_file_header
+{
+  char magic[4];
+  /* INDEX_BYTE_ORDER, as written by this machine.  */
+  uint32_t byte_order;
+  uint32_t version;
+  /* sizeof (struct changelog_sketch).  */
+  uint32_t sketch_size;
+  /* The length of the ChangeLog file.  */
+  uint64_t length;
+  uint64_t num_entries;
+};
+
+#define INDEX_MAGIC "GMCI"
+#define INDEX_BYTE_ORDER 0x01020304
+#define INDEX_VERSION 1
+
+/* The file in the cache DIR for the contents of BUFFER: the one named after
+   its git blob id.  Freshly allocated.  */
+static char *
+cache_file_name (const char *dir, const struct changelog_buffer *buffer)
+{
+  char header[32];
+  struct sha1_ctx ctx;
+  unsigned char digest[20];
+  char hex[41];
+  char *name;
+  size_t i;
+
+  /* git hashes the blob with a header.  */
+  sprintf (header, "blob %lu", (unsigned long) buffer->length);
+  sha1_init_ctx (&ctx);
+  sha1_process_bytes (header, strlen (header) + 1, &ctx);
+  sha1_process_bytes (buffer->contents, buffer->length, &ctx);
+  sha1_finish_ctx (&ctx, digest);
+  for (i = 0; i < 20; i++)
+    sprintf (hex + 2 * i, "%02x", digest[i]);
+
+  name = XNMALLOC (strlen (dir) + 1 + 2 + 1 + 38 + 1, char);
+  sprintf (name, "%s/%.2s/%s", dir, hex, hex + 2);
+  return name;
+}
+
+/* Return the size of a cache file with NUM_ENTRIES entries, or 0 if it is
+   too large.  */
+static size_t
+index_file_size (uint64_t num_entries)
+{
+  size_t per_entry = sizeof (uint64_t) + sizeof (struct changelog_sketch);
+
+  if (num_entries > (SIZE_MAX - sizeof (struct index_file_header)) / per_entry)
+    return 0;
+  return sizeof (struct index_file_header) + num_entries * per_entry;
+}
+
+/* Load the cache file NAME for a ChangeLog file of LENGTH bytes into
+   memory.  Return true and the index in *RESULT, or false if the file does
+   not exist or does not fit.  */
+static bool
+load_index_file (const char *name, size_t length,
+                 struct changelog_cached_index *result)
+{
+  const struct index_file_header *header;
+  void *memory;
+  size_t memory_length;
+  bool mapped;
+
+#if HAVE_MMAP
+  {
+    struct stat statbuf;
+    int fd = open (name, O_RDONLY);
+
+    if (fd < 0)
+      return false;
+    if (fstat (fd, &statbuf) < 0
+        || statbuf.st_size < (off_t) sizeof (struct index_file_header))
+      {
+        close (fd);
+        return false;
+      }
+    memory_length = statbuf.st_size;
+    memory = mmap (NULL, memory_length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (memory == MAP_FAILED)
+      return false;
+    mapped = true;
+  }
+#else
+  memory = read_file (name, &memory_length);
+  if (memory == NULL)
+    return false;
+  mapped = false;
+#endif
+
+  header = (const struct index_file_header *) memory;
+  if (!(memory_length >= sizeof (struct index_file_header)
+        && memcmp (header->magic, INDEX_MAGIC, 4) == 0
+        && header->byte_order == INDEX_BYTE_ORDER
+        && header->version == INDEX_VERSION
+        && header->sketch_size == sizeof (struct changelog_sketch)
+        && header->length == length
+        && index_file_size (header->num_entries) == memory_length))
+    {
+#if HAVE_MMAP
+      munmap (memory, memory_length);
+#else
+      free (memory);
+#endif
+      return false;
+    }
+
+  result->index.num_entries = header->num_entries;
+  result->index.ends = (const uint64_t *) (header + 1);
+  result->index.sketches =
+    (const struct changelog_sketch *) (result->index.ends
+                                       + header->num_entries);
+  result->hit = true;
+  result->memory = memory;
+  result->memory_length = memory_length;
+  result->mapped = mapped;
+  return true;
+}
+
+/* Store INDEX, for a ChangeLog file of LENGTH bytes, in the file NAME,
+   which must be in a subdirectory of DIR.  The file appears atomically.
+   Return 0, or -1 with errno set upon failure.  */
+static int
+write_index_file (const char *dir, const char *name,
+                  const struct changelog_index *index, size_t length)
+{
+  struct index_file_header header;
+  char *subdir;
+  char *tmp_name;
+  FILE *fp;
+  int fd;
+
+  /* Create the subdirectory, if needed.  */
+  subdir = xstrdup (name);
+  *strrchr (subdir, '/') = '\0';
+  if (mkdir (subdir, 0777) < 0 && errno != EEXIST)
+    {
+      free (subdir);
+      return -1;
+    }
+  free (subdir);
+
+  tmp_name = XNMALLOC (strlen (dir) + 1 + 10 + 1, char);
+  sprintf (tmp_name, "%s/tmp-XXXXXX", dir);
+  fd = mkstemp (tmp_name);
+  if (fd < 0)
+    {
+      free (tmp_name);
+      return -1;
+    }
+  fp = fdopen (fd, "wb");
+  if (fp == NULL)
+    {
+      int saved_errno = errno;
+      close (fd);
+      unlink (tmp_name);
+      free (tmp_name);
+      errno = saved_errno;
+      return -1;
+    }
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, INDEX_MAGIC, 4);
+  header.byte_order = INDEX_BYTE_ORDER;
+  header.version = INDEX_VERSION;
+  header.sketch_size = sizeof (struct changelog_sketch);
+  header.length = length;
+  header.num_entries = index->num_entries;
+  fwrite (&header, sizeof (header), 1, fp);
+  fwrite (index->ends, sizeof (uint64_t), index->num_entries, fp);
+  fwrite (index->sketches, sizeof (struct changelog_sketch),
+          index->num_entries, fp);
+  if (ferror (fp) | (fclose (fp) != 0) || rename (tmp_name, name) < 0)
+    {
+      int saved_errno = errno;
+      unlink (tmp_name);
+      free (tmp_name);
+      errno = saved_errno;
+      return -1;
+    }
+  free (tmp_name);
+  return 0;
+}
+
+bool
+changelog_index_cache_get (const char *dir,
+                           const struct changelog_buffer *buffer,
+                           struct changelog_cached_index *result)
+{
+  char *name = cache_file_name (dir, buffer);
+
+  if (load_index_file (name, buffer->length, result))
+    {
+      free (name);
+      return true;
+    }
+
+  if (changelog_index_compute (buffer, &result->index) < 0)
+    {
+      free (name);
+      return false;
+    }
+  result->hit = false;
+  result->memory = NULL;
+  result->memory_length = 0;
+  result->mapped = false;
+
+  if (write_index_file (dir, name, &result->index, buffer->length) < 0)
+    error (0, errno, "could not write file '%s'", name);
+  free (name);
+  return true;
+}
+
+void
+changelog_index_cache_release (struct changelog_cached_index *cached)
+{
+  if (cached->memory == NULL)
+    changelog_index_free (&cached->index);
+#if HAVE_MMAP
+  else if (cached->mapped)
+    munmap (cached->memory, cached->memory_length);
+#endif
+  else
+    free (cached->memory);
+  cached->memory = NULL;
+}
@@ -0,0 +1,75 @@
+/* changelog-index-cache - reuse the indexes of ChangeLog files.
+   Copyright (C) 2008-2010 Bruno Haible <bruno@clisp.org>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _CHANGELOG_INDEX_CACHE_H
+#define _CHANGELOG_INDEX_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "changelog-merge.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* A cache of the indexes (entry boundaries and sketches) of ChangeLog files.
+
+   The same ChangeLog contents take part in many merges: the ancestor and
+   mainstream files of one merge are often those of the previous one.  The
+   cache is a directory, in which the index of the contents with git blob id
+   xxyyyy... is stored in the file xx/yyyy..., in the layout of struct
+   changelog_index, so that it can be mapped into memory as it is.
+
+   The files are written to a temporary file first and then renamed into
+   place; therefore any number of processes can use the same cache
+   concurrently.  The files are specific to the machine (byte order and
+   structure layout); a file that doesn't fit is ignored and rewritten.  */
+
+/* An index that comes from the cache.  */
+struct changelog_cached_index
+{
+  struct changelog_index index;
+  /* Whether the index was found in the cache.  */
+  bool hit;
+  /* The memory that holds the index, if it was found in the cache.  */
+  void *memory;
+  size_t memory_length;
+  bool mapped;
+};
+
+/* Look up the index of BUFFER in the cache DIR.  If it is not there, compute
+   it and store it in the cache.  Its INDEX field is ignored.
+   Return true and the index in *RESULT, or false if the index could not
+   be computed.  Problems with the cache directory are reported as warnings;
+   the index is still computed.  */
+extern bool
+       changelog_index_cache_get (const char *dir,
+                                  const struct changelog_buffer *buffer,
+                                  struct changelog_cached_index *result);
+
+/* Free the memory held by *CACHED.  */
+extern void
+       changelog_index_cache_release (struct changelog_cached_index *cached);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHANGELOG_INDEX_CACHE_H */
@@ -0,0 +1,265 @@
+/* Complexity-regression fuzz target for the ChangeLog merge engine.
+   Copyright (C) 2008-2010 Bruno Haible <bruno@clisp.org>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* This harness runs changelog_merge on fuzzer-generated inputs and aborts
+   when a merge is too expensive for the size of its input: when it performs
+   more fuzzy entry comparisons, or takes more time, than a configurable
+   function of the input size.  Such inputs are also saved in a regression
+   corpus directory, so that they can be replayed after a fix.
+
+   Input format: a byte whose bits 0, 1, 2 tell whether the ancestor,
+   mainstream and modified files get an index, as computed by
+   changelog_index_compute, and then the three files, separated by form
+   feed characters.  Missing files are empty.
+
+   Limits, set through environment variables of the form FACTOR:EXPONENT:
+     CHANGELOG_FUZZ_COMPARISONS  maximum number of fuzzy comparisons, as
+                                 FACTOR * (N + 1)^EXPONENT where N is the total
+                                 number of entries.  Default: 1:1.5.  It only
+                                 applies when all three files have an index:
+                                 without sketches, the fuzzy mapping compares
+                                 every unmatched entry with every other one,
+                                 about 2 * N^2 comparisons.  With them, the
+                                 default catches the inputs on which the
+                                 sketches and the memo stop pruning, while
+                                 ordinary merges stay below one comparison per
+                                 entry.
+     CHANGELOG_FUZZ_TIME         maximum run time in milliseconds, as
+                                 FACTOR * (K + 1)^EXPONENT where K is the total
+                                 size in KiB, for instance 20:2.  Default:
+                                 none, since the time depends on the machine,
+                                 its load, and the sanitizers.
+   CHANGELOG_FUZZ_CORPUS is the directory where offending inputs are saved.
+   Default: changelog-fuzz-regressions.
+
+   Building with libFuzzer, in the testdir created as described in
+   git-merge-changelog.c:
+
+     $ clang -g -O1 -fsanitize=fuzzer,address -I. -Igllib \
+         changelog-merge-fuzz.c changelog-merge.c gllib/libgnu.a -lm \
+         -o changelog-merge-fuzz
+     $ ./changelog-merge-fuzz corpus/
+
+   Building for AFL, or for replaying inputs without any fuzzer: define
+   CHANGELOG_FUZZ_MAIN.  Then the program runs the inputs in the files given
+   as arguments, or the one on standard input.
+
+     $ afl-gcc -DCHANGELOG_FUZZ_MAIN -I. -Igllib \
+         changelog-merge-fuzz.c changelog-merge.c gllib/libgnu.a -lm \
+         -o changelog-merge-fuzz
+     $ afl-fuzz -i seeds -o findings ./changelog-merge-fuzz
+     $ ./changelog-merge-fuzz changelog-fuzz-regressions/[0-9a-f]*
+ */
+
+#include <config.h>
+
+#include "changelog-merge.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "read-file.h"
+#include "sha1.h"
+
+/* A limit of the form FACTOR * (SIZE + 1)^EXPONENT.  */
+struct limit
+{
+  double factor;
+  double exponent;
+};
+
+/* Parse a limit from the environment variable NAME.  A FACTOR of 0 means
+   no limit.  */
+static struct limit
+get_limit (const char *name, double factor, double exponent)
+{
+  struct limit limit;
+  const char *value = getenv (name);
+
+  limit.factor = factor;
+  limit.exponent = exponent;
+  if (value != NULL
+      && sscanf (value, "%lf:%lf", &limit.factor, &limit.exponent) != 2)
+    {
+      fprintf (stderr, "invalid value of %s: %s\n", name, value);
+      exit (EXIT_FAILURE);
+    }
+  return limit;
+}
+
+static double
+limit_value (struct limit limit, double size)
+{
+  return (limit.factor > 0
+          ? limit.factor * pow (size + 1, limit.exponent)
+          : HUGE_VAL);
+}
+
+/* Save the input in the regression corpus.  */
+static void
+save_input (const uint8_t *data, size_t size)
+{
+  const char *dir = getenv ("CHANGELOG_FUZZ_CORPUS");
+  unsigned char digest[20];
+  char hex[41];
+  char *name;
+  FILE *fp;
+  int i;
+
+  if (dir == NULL)
+    dir = "changelog-fuzz-regressions";
+  if (mkdir (dir, 0777) < 0 && errno != EEXIST)
+    {
+      fprintf (stderr, "could not create directory '%s'\n", dir);
+      return;
+    }
+  sha1_buffer ((const char *) data, size, digest);
+  for (i = 0; i < 20; i++)
+    sprintf (hex + 2 * i, "%02x", digest[i]);
+  name = (char *) malloc (strlen (dir) + 1 + 40 + 1);
+  if (name == NULL)
+    return;
+  sprintf (name, "%s/%s", dir, hex);
+  fp = fopen (name, "wb");
+  if (fp == NULL
+      || fwrite (data, 1, size, fp) != size
+      || fclose (fp) != 0)
+    fprintf (stderr, "could not write file '%s'\n", name);
+  else
+    fprintf (stderr, "saved input as '%s'\n", name);
+  free (name);
+}
+
+int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size);
+
+int
+LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+  struct changelog_buffer files[3];
+  struct changelog_index indexes[3];
+  const char *p = (const char *) data;
+  const char *end = p + size;
+  struct changelog_merge_options options;
+  struct changelog_merge_result result;
+  struct timespec start;
+  struct timespec stop;
+  double elapsed;
+  size_t entries;
+  double max_comparisons;
+  double max_time;
+  int indexed;
+  int merged;
+  int f;
+
+  /* Dissect the input.  */
+  indexed = (p < end ? *p++ & 7 : 0);
+  for (f = 0; f < 3; f++)
+    {
+      const char *sep = (f < 2 ? memchr (p, '\f', end - p) : NULL);
+      files[f].contents = p;
+      files[f].length = (sep != NULL ? sep : end) - p;
+      files[f].index = NULL;
+      p = (sep != NULL ? sep + 1 : end);
+    }
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  for (f = 0; f < 3; f++)
+    if (indexed & (1 << f))
+      {
+        if (changelog_index_compute (&files[f], &indexes[f]) < 0)
+          indexed &= ~(1 << f);
+        else
+          files[f].index = &indexes[f];
+      }
+
+  changelog_merge_options_init (&options);
+  merged = changelog_merge (&files[0], &files[1], &files[2], 1, &options,
+                            &result);
+  clock_gettime (CLOCK_MONOTONIC, &stop);
+  for (f = 0; f < 3; f++)
+    if (indexed & (1 << f))
+      changelog_index_free (&indexes[f]);
+  if (merged < 0)
+    return 0;
+  elapsed = (stop.tv_sec - start.tv_sec) * 1e3
+            + (stop.tv_nsec - start.tv_nsec) / 1e6;
+
+  /* Check the cost against the limits.  */
+  entries = result.stats.ancestor_entries + result.stats.mainstream_entries
+            + result.stats.modified_entries;
+  max_comparisons =
+    (indexed == 7
+     ? limit_value (get_limit ("CHANGELOG_FUZZ_COMPARISONS", 1, 1.5), entries)
+     : HUGE_VAL);
+  max_time =
+    limit_value (get_limit ("CHANGELOG_FUZZ_TIME", 0, 2), size / 1024.0);
+  if (result.stats.comparisons > max_comparisons || elapsed > max_time)
+    {
+      fprintf (stderr,
+               "too expensive: %lu entries, %lu bytes: "
+               "%lu comparisons (limit %.0f), %.1f ms (limit %.1f ms)\n",
+               (unsigned long) entries, (unsigned long) size,
+               (unsigned long) result.stats.comparisons, max_comparisons,
+               elapsed, max_time);
+      save_input (data, size);
+      abort ();
+    }
+
+  changelog_merge_result_free (&result);
+  return 0;
+}
+
+#ifdef CHANGELOG_FUZZ_MAIN
+
+int
+main (int argc, char *argv[])
+{
+  int i;
+
+  if (argc == 1)
+    {
+      size_t length;
+      char *contents = fread_file (stdin, &length);
+      if (contents == NULL)
+        {
+          fprintf (stderr, "could not read standard input\n");
+          return EXIT_FAILURE;
+        }
+      LLVMFuzzerTestOneInput ((const uint8_t *) contents, length);
+      free (contents);
+    }
+  for (i = 1; i < argc; i++)
+    {
+      size_t length;
+      char *contents = read_file (argv[i], &length);
+      if (contents == NULL)
+        {
+          fprintf (stderr, "could not read file '%s'\n", argv[i]);
+          return EXIT_FAILURE;
+        }
+      LLVMFuzzerTestOneInput ((const uint8_t *) contents, length);
+      free (contents);
+    }
+  return EXIT_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,2457 @@
+/* changelog-merge - merge engine for GNU style ChangeLog files.
+   Copyright (C) 2008-2010 Bruno Haible <bruno@clisp.org>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+/* How it works:
+   The structure of a ChangeLog file: It consists of ChangeLog entries. A
+   ChangeLog entry starts at a line following a blank line and that starts with
+   a non-whitespace character, or at the beginning of a file.
+   The merge driver works as follows: It reads the three files into memory and
+   dissects them into ChangeLog entries. It then finds the differences between
+   %O and %B. They are classified as:
+     - removals (some consecutive entries removed),
+     - changes (some consecutive entries removed, some consecutive entries
+       added),
+     - additions (some consecutive entries added).
+   The driver then attempts to apply the changes to %A.
+   To this effect, it first computes a correspondence between the entries in %O
+   and the entries in %A, using fuzzy string matching to still identify changed
+   entries.
+     - Removals are applied one by one. If the entry is present in %A, at any
+       position, it is removed. If not, the removal is marked as a conflict.
+     - Additions at the top of %B are applied at the top of %A.
+     - Additions between entry x and entry y (y may be the file end) in %B are
+       applied between entry x and entry y in %A (if they still exist and are
+       still consecutive in %A), otherwise the additions are marked as a
+       conflict.
+     - Changes are categorized into "simple changes":
+         entry1 ... entryn
+       are mapped to
+         added_entry ... added_entry modified_entry1 ... modified_entryn,
+       where the correspondence between entry_i and modified_entry_i is still
+       clear; and "big changes": these are all the rest. Simple changes at the
+       top of %B are applied by putting the added entries at the top of %A. The
+       changes in simple changes are applied one by one; possibly leading to
+       single-entry conflicts. Big changes are applied en bloc, possibly
+       leading to conflicts spanning multiple entries.
+     - Conflicts are output at the top of the file and cause an exit status of
+       1.
+ */
+
+#include <config.h>
+
+/* Specification.  */
+#include "changelog-merge.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "glthread/thread.h"
+#include "gl_xlist.h"
+#include "gl_array_list.h"
+#include "gl_linkedhash_list.h"
+#include "gl_linked_list.h"
+#include "xalloc.h"
+#include "xmalloca.h"
+#include "fstrcmp.h"
+#include "minmax.h"
+#include "nproc.h"
+
+#define ASSERT(expr) \
+  do                                                                         \
+    {                                                                        \
+      if (!(expr))                                                           \
+        abort ();                                                            \
+    }                                                                        \
+  while (0)
+
+#define FSTRCMP_THRESHOLD 0.6
+#define FSTRCMP_STRICTER_THRESHOLD 0.8
+
+#if USE_POSIX_THREADS || USE_SOLARIS_THREADS || USE_PTH_THREADS || USE_WIN32_THREADS
+# define ENABLE_THREADS 1
+#else
+# define ENABLE_THREADS 0
+#endif
+
+/* Files larger than this are searched for entry boundaries by several
+   threads, each taking a piece of at least this size.  */
+#define SCAN_CHUNK_MIN (4 * 1024 * 1024)
+
+/* Indices of entries within a file, and entry ids, are stored in 32 bits,
+   unless WIDE_ENTRY_INDICES is defined.  This halves the size of the mapping
+   arrays and of the vectors that the diff algorithm works on.  */
+#if WIDE_ENTRY_INDICES
+typedef ssize_t entry_index_t;
+typedef size_t entry_id_t;
+# define ENTRY_INDEX_MAX SSIZE_MAX
+#else
+typedef int32_t entry_index_t;
+typedef uint32_t entry_id_t;
+# define ENTRY_INDEX_MAX INT32_MAX
+#endif
+
+/* The largest number of entries in a file.  The diff algorithm works on two
+   files at a time, with offsets up to the sum of their numbers of entries
+   plus 3, and these must fit in an entry_index_t too.  */
+#define ENTRY_COUNT_MAX ((ENTRY_INDEX_MAX - 3) / 2)
+
+/* Representation of a ChangeLog entry.
+   The string may contain NUL bytes; therefore it is represented as a plain
+   opaque memory region.  */
+struct entry
+{
+  const char *string;
+  size_t length;
+  /* The hash code of the contents.  */
+  size_t hashcode;
+  /* Identifier of the contents.  Two interned entries have the same id if
+     and only if they have the same contents.  NO_ENTRY_ID for entries that
+     are not interned.  */
+  entry_id_t id;
+  /* The sketch of the entry, or NULL if it has none.  */
+  const struct changelog_sketch *sketch;
+};
+
+#define NO_ENTRY_ID ((entry_id_t) -1)
+
+/* What is known about a pair of interned entries.  */
+struct pair_memo
+{
+  /* The ids of the entries, or NO_ENTRY_ID in ID1 for an unused slot.  */
+  entry_id_t id1;
+  entry_id_t id2;
+  /* The result of entry_fstrcmp.  If similarity_exact, SIMILARITY is the
+     exact similarity.  Otherwise, the similarity is known to be less than
+     SIMILARITY_BOUND, the lower bound that was passed, and SIMILARITY is the
+     value that was returned.  */
+  bool have_similarity;
+  bool similarity_exact;
+  double similarity;
+  double similarity_bound;
+  /* The result of try_split_merged_entry: the two new entries, or NULL if
+     the new entry cannot be split.  */
+  bool have_split;
+  struct entry *split[2];
+  /* The number of comparisons that try_split_merged_entry needed.  */
+  size_t split_comparisons;
+};
+
+/* Number of slots in the table of pair memos.  A pair takes the slot of
+   whatever pair was there before, so that the table stays bounded however
+   many pairs the fuzzy mapping compares; an evicted pair is just compared
+   again.  */
+#define PAIR_MEMO_SLOTS 32768
+
+static size_t
+pair_memo_slot (entry_id_t id1, entry_id_t id2)
+{
+  /* The finalizer of MurmurHash3, which mixes all the bits.  */
+  uint32_t h = (uint32_t) id1 * 2654435761u ^ (uint32_t) id2;
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h % PAIR_MEMO_SLOTS;
+}
+
+/* The state of one merge.  */
+struct merge_context
+{
+  /* The set of distinct entry contents seen so far, across all files.
+     The element with id i is at position i.  */
+  gl_list_t /* <struct entry *> */ interned_entries;
+  /* The entries created by entry_create.  They are freed together with the
+     context.  */
+  gl_list_t /* <struct entry *> */ created_entries;
+  /* An empty entry.  */
+  struct entry empty_entry;
+  /* What is known about pairs of interned entries, so that most pairs are
+     not compared twice: a table of PAIR_MEMO_SLOTS slots, or NULL until the
+     first fuzzy comparison.  */
+  struct pair_memo *pair_memos;
+  /* The time budget for the merge.  When it is used up, the expensive stages
+     fall back to cheaper, coarser computations.  */
+  bool have_deadline;
+  struct timespec deadline;
+  bool deadline_passed;
+  /* Number of budget checks left before the clock is read again.  */
+  int budget_countdown;
+  /* Statistics, including the stages that had to cut their work short
+     because of the time budget.  */
+  struct changelog_merge_stats *stats;
+};
+
+/* The time budget is checked in the inner loops of the fuzzy mapping, once
+   per comparison.  The clock is read only at every so many checks, so that
+   it stays off the profile; the deadline is then noticed at most that many
+   comparisons late.  */
+#define BUDGET_CHECK_INTERVAL 64
+
+/* Start the time budget of CTX: BUDGET_MS milliseconds from now.  */
+static void
+budget_start (struct merge_context *ctx, long budget_ms)
+{
+  clock_gettime (CLOCK_MONOTONIC, &ctx->deadline);
+  ctx->deadline.tv_sec += budget_ms / 1000;
+  ctx->deadline.tv_nsec += (budget_ms % 1000) * 1000000;
+  if (ctx->deadline.tv_nsec >= 1000000000)
+    {
+      ctx->deadline.tv_sec++;
+      ctx->deadline.tv_nsec -= 1000000000;
+    }
+  ctx->have_deadline = true;
+  ctx->budget_countdown = 0;
+}
+
+/* Return true if the time budget of CTX is used up.  In this case, also set
+   *DEGRADED, to record that the calling stage produced a coarser result.  */
+static bool
+budget_exhausted (struct merge_context *ctx, bool *degraded)
+{
+  if (ctx->have_deadline && !ctx->deadline_passed
+      && --ctx->budget_countdown < 0)
+    {
+      struct timespec now;
+      ctx->budget_countdown = BUDGET_CHECK_INTERVAL - 1;
+      clock_gettime (CLOCK_MONOTONIC, &now);
+      ctx->deadline_passed =
+        (now.tv_sec > ctx->deadline.tv_sec
+         || (now.tv_sec == ctx->deadline.tv_sec
+             && now.tv_nsec >= ctx->deadline.tv_nsec));
+    }
+  if (ctx->deadline_passed)
+    *degraded = true;
+  return ctx->deadline_passed;
+}
+
+/* Return the time elapsed since *START, in microseconds, and set *START to
+   the current time.  */
+static unsigned long
+phase_time (struct timespec *start)
+{
+  struct timespec now;
+  unsigned long elapsed;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  elapsed = (now.tv_sec - start->tv_sec) * 1000000L
+            + (now.tv_nsec - start->tv_nsec) / 1000;
+  *start = now;
+  return elapsed;
+}
+
+/* Return a hash code of the contents of a ChangeLog entry.  */
+static size_t
+entry_hashcode (const void *elt)
+{
+  const struct entry *entry = (const struct entry *) elt;
+  return entry->hashcode;
+}
+
+/* Compare the contents of two entries.  */
+static bool
+entry_contents_equals (const void *elt1, const void *elt2)
+{
+  const struct entry *entry1 = (const struct entry *) elt1;
+  const struct entry *entry2 = (const struct entry *) elt2;
+  return entry1->length == entry2->length
+         && memcmp (entry1->string, entry2->string, entry1->length) == 0;
+}
+
+/* Assign an id to an entry, such that entries with equal contents get the
+   same id within CTX.  */
+static void
+entry_intern (struct merge_context *ctx, struct entry *entry)
+{
+  gl_list_node_t node = gl_list_search (ctx->interned_entries, entry);
+  if (node != NULL)
+    entry->id =
+      ((const struct entry *)
+       gl_list_node_value (ctx->interned_entries, node))->id;
+  else
+    {
+      entry->id = gl_list_size (ctx->interned_entries);
+      gl_list_add_last (ctx->interned_entries, entry);
+    }
+}
+
+/* Initialize an entry, without interning it.
+   The memory region passed by the caller must live as long as the entry.
+   It is *not* copied here.  */
+static void
+entry_init (struct entry *entry, const char *string, size_t length)
+{
+  /* See http://www.haible.de/bruno/hashfunc.html.  */
+  const char *s;
+  size_t n;
+  size_t h = 0;
+
+  for (s = string, n = length; n > 0; s++, n--)
+    h = (unsigned char) *s + ((h << 9) | (h >> (sizeof (size_t) * CHAR_BIT - 9)));
+
+  entry->string = string;
+  entry->length = length;
+  entry->hashcode = h;
+  entry->id = NO_ENTRY_ID;
+  entry->sketch = NULL;
+}
+
+/* Create an entry, consisting of the concatenation of two memory regions.
+   The contents are copied.  The entry is freed together with CTX.  */
+static struct entry *
+entry_create (struct merge_context *ctx,
+              const char *string1, size_t length1,
+              const char *string2, size_t length2)
+{
+  struct entry *result =
+    (struct entry *) xmalloc (sizeof (struct entry) + length1 + length2);
+  char *string = (char *) (result + 1);
+  memcpy (string, string1, length1);
+  memcpy (string + length1, string2, length2);
+  entry_init (result, string, length1 + length2);
+  entry_intern (ctx, result);
+  gl_list_add_last (ctx->created_entries, result);
+  return result;
+}
+
+/* Initialize a merge context.  STATS is where it collects statistics.  */
+static void
+merge_context_init (struct merge_context *ctx,
+                    struct changelog_merge_stats *stats)
+{
+  ctx->interned_entries =
+    gl_list_create_empty (GL_LINKEDHASH_LIST, entry_contents_equals,
+                          entry_hashcode, NULL, false);
+  ctx->created_entries =
+    gl_list_create_empty (GL_ARRAY_LIST, NULL, NULL, NULL, true);
+  ctx->empty_entry.string = NULL;
+  ctx->empty_entry.length = 0;
+  ctx->empty_entry.hashcode = 0;
+  ctx->empty_entry.id = NO_ENTRY_ID;
+  ctx->empty_entry.sketch = NULL;
+  ctx->pair_memos = NULL;
+  ctx->have_deadline = false;
+  ctx->deadline_passed = false;
+  ctx->budget_countdown = 0;
+  ctx->stats = stats;
+}
+
+/* Free the memory held by a merge context.  */
+static void
+merge_context_free (struct merge_context *ctx)
+{
+  size_t n = gl_list_size (ctx->created_entries);
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    free ((void *) gl_list_get_at (ctx->created_entries, i));
+  gl_list_free (ctx->created_entries);
+  gl_list_free (ctx->interned_entries);
+  free (ctx->pair_memos);
+}
+
+/* Return the memo of a pair of interned entries, or NULL if one of the
+   entries is not interned.  The memo is valid until the next call.  */
+static struct pair_memo *
+pair_memo_get (struct merge_context *ctx,
+               const struct entry *entry1, const struct entry *entry2)
+{
+  struct pair_memo *memo;
+
+  if (entry1->id == NO_ENTRY_ID || entry2->id == NO_ENTRY_ID)
+    return NULL;
+  if (ctx->pair_memos == NULL)
+    {
+      size_t i;
+
+      ctx->pair_memos = XNMALLOC (PAIR_MEMO_SLOTS, struct pair_memo);
+      for (i = 0; i < PAIR_MEMO_SLOTS; i++)
+        ctx->pair_memos[i].id1 = NO_ENTRY_ID;
+    }
+  memo = &ctx->pair_memos[pair_memo_slot (entry1->id, entry2->id)];
+  if (memo->id1 == entry1->id && memo->id2 == entry2->id)
+    return memo;
+  if (memo->id1 != NO_ENTRY_ID)
+    ctx->stats->memo_evictions++;
+  memo->id1 = entry1->id;
+  memo->id2 = entry2->id;
+  memo->have_similarity = false;
+  memo->have_split = false;
+  return memo;
+}
+
+/* Compare two interned entries for equality.  */
+static bool
+entry_equals (const void *elt1, const void *elt2)
+{
+  const struct entry *entry1 = (const struct entry *) elt1;
+  const struct entry *entry2 = (const struct entry *) elt2;
+  return entry1->id == entry2->id;
+}
+
+/* Return an upper bound for the similarity of two entries that have sketches,
+   as computed by entry_fstrcmp.  Every character that is not part of the
+   longest common subsequence of the entries costs an edit, and there are at
+   least as many of them as differences between the character class counts.
+   (Saturated counts make the bound only larger.)  */
+static double
+sketch_similarity_bound (const struct entry *entry1,
+                         const struct entry *entry2)
+{
+  size_t total = entry1->length + entry2->length;
+  size_t differences = 0;
+  int c;
+
+  for (c = 0; c < CHANGELOG_SKETCH_CLASSES; c++)
+    {
+      int d = (int) entry1->sketch->classes[c] - entry2->sketch->classes[c];
+      differences += (d >= 0 ? d : -d);
+    }
+  /* The same expression as in fstrcmp, so that the bound is not less than
+     the similarity because of rounding errors.  */
+  return (total > 0 ? (double) (total - differences) / total : 1.0);
+}
+
+/* Return the number of equal MinHash values of two sketches.  */
+static unsigned int
+sketch_minhash_matches (const struct changelog_sketch *sketch1,
+                        const struct changelog_sketch *sketch2)
+{
+  unsigned int matches = 0;
+  int k;
+
+  for (k = 0; k < CHANGELOG_SKETCH_HASHES; k++)
+    matches += (sketch1->minhash[k] == sketch2->minhash[k]);
+  return matches;
+}
+
+/* Perform a fuzzy comparison of two ChangeLog entries.
+   Return a similarity measure of the two entries, a value between 0 and 1.
+   0 stands for very distinct, 1 for identical.
+   If the result is < LOWER_BOUND, an arbitrary other value < LOWER_BOUND can
+   be returned.
+   For interned entries, the result is remembered in CTX.  */
+static double
+entry_fstrcmp (struct merge_context *ctx,
+               const struct entry *entry1, const struct entry *entry2,
+               double lower_bound)
+{
+  /* fstrcmp works only on NUL terminated strings.  */
+  char *memory;
+  double similarity;
+  struct pair_memo *memo;
+
+  if (entry1->id == entry2->id && entry1->id != NO_ENTRY_ID)
+    return 1.0;
+  if (entry1->sketch != NULL && entry2->sketch != NULL)
+    {
+      if ((entry1->sketch->flags | entry2->sketch->flags)
+          & CHANGELOG_SKETCH_HAS_NUL)
+        return 0.0;
+      if (lower_bound > 0.0
+          && sketch_similarity_bound (entry1, entry2) < lower_bound)
+        {
+          /* Like fstrcmp_bounded does with its own bound.  */
+          ctx->stats->sketch_pruned++;
+          return 0.0;
+        }
+    }
+  else
+    {
+      if (memchr (entry1->string, '\0', entry1->length) != NULL)
+        return 0.0;
+      if (memchr (entry2->string, '\0', entry2->length) != NULL)
+        return 0.0;
+    }
+
+  memo = pair_memo_get (ctx, entry1, entry2);
+  if (memo != NULL && memo->have_similarity
+      && (memo->similarity_exact || lower_bound >= memo->similarity_bound))
+    {
+      /* Either the exact similarity is known, or it is known to be less than
+         a bound that is at most LOWER_BOUND.  */
+      ctx->stats->similarity_avoided++;
+      return memo->similarity;
+    }
+
+  memory = (char *) xmalloca (entry1->length + 1 + entry2->length + 1);
+  {
+    char *p = memory;
+    memcpy (p, entry1->string, entry1->length);
+    p += entry1->length;
+    *p++ = '\0';
+    memcpy (p, entry2->string, entry2->length);
+    p += entry2->length;
+    *p++ = '\0';
+  }
+  similarity =
+    fstrcmp_bounded (memory, memory + entry1->length + 1, lower_bound);
+  ctx->stats->comparisons++;
+  freea (memory);
+
+  if (memo != NULL)
+    {
+      memo->have_similarity = true;
+      memo->similarity_exact = (similarity >= lower_bound);
+      memo->similarity = similarity;
+      memo->similarity_bound = lower_bound;
+    }
+  return similarity;
+}
+
+/* This structure represents an entire ChangeLog file, after it was read
+   into memory.  */
+struct changelog_file
+{
+  /* The entries, as an array.  */
+  size_t num_entries;
+  struct entry **entries;
+  /* The ids of the entries, as an array parallel to ENTRIES.  */
+  entry_id_t *entry_ids;
+  /* The memory block holding the entries.  */
+  struct entry *storage;
+};
+
+/* A piece of a ChangeLog file that is searched for entry boundaries.  */
+struct scan_chunk
+{
+  const char *contents;
+  /* The range of positions where an entry may start.  */
+  size_t start;
+  size_t end;
+  /* The entry starts that were found, in increasing order.  */
+  size_t *starts;
+  size_t num_starts;
+  size_t starts_alloc;
+};
+
+/* Find the entry starts in a piece of a ChangeLog file.
+   A ChangeLog entry starts at a line following a blank line and that starts
+   with a non-whitespace character, or at the beginning of a file.  Whether a
+   position is such a start depends only on the two bytes before it and on
+   the byte at it; therefore the pieces of a file can be searched
+   independently, and the results simply be concatenated.  */
+static void *
+scan_chunk (void *arg)
+{
+  struct scan_chunk *chunk = (struct scan_chunk *) arg;
+
+  chunk->starts = NULL;
+  chunk->num_starts = 0;
+  chunk->starts_alloc = 0;
+  if (chunk->end > 2)
+    {
+      /* Search the newline two bytes before every possible start.  */
+      const char *ptr =
+        chunk->contents + (chunk->start > 2 ? chunk->start : 2) - 2;
+      const char *ptr_end = chunk->contents + chunk->end - 2;
+
+      while (ptr < ptr_end)
+        {
+          ptr = memchr (ptr, '\n', ptr_end - ptr);
+          if (ptr == NULL)
+            break;
+          if (ptr[1] == '\n'
+              && !(ptr[2] == '\n' || ptr[2] == '\t' || ptr[2] == ' '))
+            {
+              if (chunk->num_starts == chunk->starts_alloc)
+                chunk->starts =
+                  (size_t *) x2nrealloc (chunk->starts, &chunk->starts_alloc,
+                                         sizeof (size_t));
+              chunk->starts[chunk->num_starts++] =
+                ptr + 2 - chunk->contents;
+            }
+          ptr++;
+        }
+    }
+  return NULL;
+}
+
+/* Find the entry boundaries of a ChangeLog file.
+   Return the end offsets of the entries in *ENDS, a freshly allocated
+   array, and their number in *NUM_ENDS.  */
+static void
+find_entry_ends (const char *contents, size_t length,
+                 size_t **ends, size_t *num_ends)
+{
+  size_t num_chunks = 1;
+  struct scan_chunk *chunks;
+  size_t total;
+  size_t c;
+
+#if ENABLE_THREADS
+  if (length / SCAN_CHUNK_MIN > 1)
+    num_chunks = MIN (length / SCAN_CHUNK_MIN, num_processors (NPROC_CURRENT));
+#endif
+
+  chunks = XNMALLOC (num_chunks, struct scan_chunk);
+  for (c = 0; c < num_chunks; c++)
+    {
+      chunks[c].contents = contents;
+      chunks[c].start = length / num_chunks * c;
+      chunks[c].end =
+        (c + 1 < num_chunks ? length / num_chunks * (c + 1) : length);
+    }
+#if ENABLE_THREADS
+  if (num_chunks > 1)
+    {
+      gl_thread_t *threads = XNMALLOC (num_chunks - 1, gl_thread_t);
+      for (c = 1; c < num_chunks; c++)
+        threads[c - 1] = gl_thread_create (scan_chunk, &chunks[c]);
+      scan_chunk (&chunks[0]);
+      for (c = 1; c < num_chunks; c++)
+        gl_thread_join (threads[c - 1], NULL);
+      free (threads);
+    }
+  else
+#endif
+    scan_chunk (&chunks[0]);
+
+  /* Concatenate the results.  The last entry ends at the end of the file.  */
+  total = (length > 0 ? 1 : 0);
+  for (c = 0; c < num_chunks; c++)
+    total += chunks[c].num_starts;
+  *ends = XNMALLOC (total, size_t);
+  *num_ends = 0;
+  for (c = 0; c < num_chunks; c++)
+    {
+      if (chunks[c].num_starts > 0)
+        {
+          memcpy (*ends + *num_ends, chunks[c].starts,
+                  chunks[c].num_starts * sizeof (size_t));
+          *num_ends += chunks[c].num_starts;
+        }
+      free (chunks[c].starts);
+    }
+  if (length > 0)
+    (*ends)[(*num_ends)++] = length;
+  free (chunks);
+}
+
+/* Tell whether INDEX is consistent with a file of LENGTH bytes.  An index
+   read from a cache may be stale or corrupt, and the entry lengths and title
+   lengths are used without further checks.  */
+static bool
+index_fits (const struct changelog_index *index, size_t length)
+{
+  uint64_t start = 0;
+  size_t k;
+
+  for (k = 0; k < index->num_entries; k++)
+    {
+      const struct changelog_sketch *sketch = &index->sketches[k];
+
+      /* find_paragraph_end returns at least 1 for an entry that is not
+         empty.  */
+      if (!(index->ends[k] > start
+            && sketch->length == index->ends[k] - start
+            && sketch->title_length > 0
+            && sketch->title_length <= sketch->length))
+        return false;
+      start = index->ends[k];
+    }
+  return start == length;
+}
+
+/* Split the contents of a ChangeLog file into entries.
+   If the buffer has an index, its entries and sketches are used.
+   The entries are not yet interned; see intern_changelog_file.
+   This function does not access any merge context; several invocations
+   can run in parallel.
+   The buffer must live as long as RESULT.
+   Return true and the entries in *RESULT, or false with errno set upon
+   failure.  */
+static bool
+split_changelog_file (const struct changelog_buffer *buffer,
+                      struct changelog_file *result)
+{
+  const char *contents = buffer->contents;
+  const struct changelog_index *index = buffer->index;
+  size_t *ends;
+  size_t num_ends;
+  struct entry *storage;
+  size_t entry_start;
+  size_t k;
+
+  if (index != NULL && !index_fits (index, buffer->length))
+    index = NULL;
+  if (index != NULL)
+    {
+      ends = NULL;
+      num_ends = index->num_entries;
+    }
+  else
+    find_entry_ends (contents, buffer->length, &ends, &num_ends);
+
+  if (num_ends > ENTRY_COUNT_MAX)
+    {
+      free (ends);
+      errno = EOVERFLOW;
+      return false;
+    }
+
+  /* Create all entries in a single block of memory.  */
+  result->num_entries = num_ends;
+  result->entries = XNMALLOC (num_ends, struct entry *);
+  storage = XNMALLOC (num_ends, struct entry);
+  result->storage = storage;
+  entry_start = 0;
+  for (k = 0; k < num_ends; k++)
+    {
+      size_t entry_end = (index != NULL ? index->ends[k] : ends[k]);
+      entry_init (&storage[k], contents + entry_start, entry_end - entry_start);
+      if (index != NULL)
+        storage[k].sketch = &index->sketches[k];
+      result->entries[k] = &storage[k];
+      entry_start = entry_end;
+    }
+  free (ends);
+
+  return true;
+}
+
+/* Intern the entries of a ChangeLog file in CTX, and complete *FILE.  */
+static void
+intern_changelog_file (struct merge_context *ctx, struct changelog_file *file)
+{
+  size_t n = file->num_entries;
+  size_t k;
+
+  file->entry_ids = XNMALLOC (n, entry_id_t);
+  for (k = 0; k < n; k++)
+    {
+      struct entry *curr = file->entries[k];
+
+      entry_intern (ctx, curr);
+      file->entry_ids[k] = curr->id;
+    }
+}
+
+/* Arguments and result of split_changelog_file, for use in a thread.  */
+struct split_job
+{
+  const struct changelog_buffer *buffer;
+  struct changelog_file *result;
+  bool ok;
+  int error;
+};
+
+static void *
+split_job_run (void *arg)
+{
+  struct split_job *job = (struct split_job *) arg;
+
+  job->ok = split_changelog_file (job->buffer, job->result);
+  job->error = (job->ok ? 0 : errno);
+  return NULL;
+}
+
+/* Free the memory held by a ChangeLog file.  */
+static void
+changelog_file_free (struct changelog_file *file)
+{
+  free (file->entries);
+  free (file->entry_ids);
+  free (file->storage);
+}
+
+/* A mapping (correspondence) between entries of FILE1 and of FILE2.  */
+struct entries_mapping
+{
+  struct merge_context *ctx;
+  struct changelog_file *file1;
+  struct changelog_file *file2;
+  /* Mapping from indices in FILE1 to indices in FILE2.
+     A value -1 means that the entry from FILE1 is not found in FILE2.
+     A value -2 means that it has not yet been computed.  */
+  entry_index_t *index_mapping;
+  /* Mapping from indices in FILE2 to indices in FILE1.
+     A value -1 means that the entry from FILE2 is not found in FILE1.
+     A value -2 means that it has not yet been computed.  */
+  entry_index_t *index_mapping_reverse;
+};
+
+/* Minimum number of equal MinHash values for an entry to be compared first
+   in find_most_similar.  */
+#define SEED_MIN_MATCHES (CHANGELOG_SKETCH_HASHES / 4)
+
+/* Search the entries of FILE with index K such that TAKEN[K] < 0 for the
+   one that is most similar to ENTRY.  ENTRY_FIRST tells whether ENTRY is
+   the first or the second argument of the comparisons.  The entries are
+   searched from the end of the file; among several equally similar entries,
+   the first one found wins.
+   Return its index and its similarity in *SIMILARITYP, or -1 and 0.0 if
+   no entry is similar at all or the time budget is used up.  */
+static entry_index_t
+find_most_similar (struct merge_context *ctx, const struct entry *entry,
+                   bool entry_first, const struct changelog_file *file,
+                   const entry_index_t *taken, double *similarityp)
+{
+  entry_index_t n = file->num_entries;
+  entry_index_t seed = -1;
+  entry_index_t best = -1;
+  double best_similarity = 0.0;
+  entry_index_t k;
+
+  /* Compare first with the entry that the sketches suggest as the most
+     similar one.  A good similarity found early lets most other comparisons
+     be cut short, or avoided through the sketches.  */
+  if (entry->sketch != NULL)
+    {
+      unsigned int seed_score = 2 * SEED_MIN_MATCHES - 1;
+
+      for (k = n - 1; k >= 0; k--)
+        if (taken[k] < 0 && file->entries[k]->sketch != NULL)
+          {
+            const struct changelog_sketch *sketch = file->entries[k]->sketch;
+            unsigned int score =
+              2 * sketch_minhash_matches (entry->sketch, sketch)
+              + (sketch->title_length == entry->sketch->title_length
+                 && sketch->title_hash == entry->sketch->title_hash);
+            if (score > seed_score)
+              {
+                seed = k;
+                seed_score = score;
+              }
+          }
+      if (seed >= 0)
+        {
+          double similarity =
+            (entry_first
+             ? entry_fstrcmp (ctx, entry, file->entries[seed], 0.0)
+             : entry_fstrcmp (ctx, file->entries[seed], entry, 0.0));
+          if (similarity > 0.0)
+            {
+              best = seed;
+              best_similarity = similarity;
+            }
+        }
+    }
+
+  for (k = n - 1; k >= 0; k--)
+    if (taken[k] < 0 && k != seed)
+      {
+        double similarity;
+
+        if (budget_exhausted (ctx, &ctx->stats->degraded_mapping))
+          {
+            *similarityp = 0.0;
+            return -1;
+          }
+        similarity =
+          (entry_first
+           ? entry_fstrcmp (ctx, entry, file->entries[k], best_similarity)
+           : entry_fstrcmp (ctx, file->entries[k], entry, best_similarity));
+        /* An entry that comes before the seed in the search order wins over
+           it, if it is equally similar.  */
+        if (similarity > best_similarity
+            || (similarity == best_similarity && best >= 0 && best == seed
+                && k > seed))
+          {
+            best = k;
+            best_similarity = similarity;
+          }
+      }
+
+  *similarityp = best_similarity;
+  return best;
+}
+
+/* Look up (or lazily compute) the mapping of an entry in FILE1.
+   i is the index in FILE1.
+   Return the index in FILE2, or -1 when the entry is not found in FILE2.  */
+static entry_index_t
+entries_mapping_get (struct entries_mapping *mapping, entry_index_t i)
+{
+  if (mapping->index_mapping[i] < -1
+      && budget_exhausted (mapping->ctx,
+                           &mapping->ctx->stats->degraded_mapping))
+    /* No time left for a fuzzy search.  Only the exact matches count.  */
+    mapping->index_mapping[i] = -1;
+  if (mapping->index_mapping[i] < -1)
+    {
+      struct changelog_file *file1 = mapping->file1;
+      struct changelog_file *file2 = mapping->file2;
+      struct entry *entry_i = file1->entries[i];
+
+      /* Search whether it approximately occurs in file2.  */
+      double best_j_similarity;
+      entry_index_t best_j =
+        find_most_similar (mapping->ctx, entry_i, true, file2,
+                           mapping->index_mapping_reverse,
+                           &best_j_similarity);
+      if (best_j_similarity >= FSTRCMP_THRESHOLD)
+        {
+          /* Found a similar entry in file2.  */
+          struct entry *entry_j = file2->entries[best_j];
+          /* Search whether it approximately occurs in file1 at index i.  */
+          double best_i_similarity;
+          entry_index_t best_i =
+            find_most_similar (mapping->ctx, entry_j, false, file1,
+                               mapping->index_mapping, &best_i_similarity);
+          if (best_i_similarity >= FSTRCMP_THRESHOLD && best_i == i)
+            {
+              mapping->index_mapping[i] = best_j;
+              mapping->index_mapping_reverse[best_j] = i;
+            }
+        }
+      if (mapping->index_mapping[i] < -1)
+        /* It does not approximately occur in FILE2.
+           Remember it, for next time.  */
+        mapping->index_mapping[i] = -1;
+    }
+  return mapping->index_mapping[i];
+}
+
+/* Look up (or lazily compute) the mapping of an entry in FILE2.
+   j is the index in FILE2.
+   Return the index in FILE1, or -1 when the entry is not found in FILE1.  */
+static entry_index_t
+entries_mapping_reverse_get (struct entries_mapping *mapping, entry_index_t j)
+{
+  if (mapping->index_mapping_reverse[j] < -1
+      && budget_exhausted (mapping->ctx,
+                           &mapping->ctx->stats->degraded_mapping))
+    /* No time left for a fuzzy search.  Only the exact matches count.  */
+    mapping->index_mapping_reverse[j] = -1;
+  if (mapping->index_mapping_reverse[j] < -1)
+    {
+      struct changelog_file *file1 = mapping->file1;
+      struct changelog_file *file2 = mapping->file2;
+      struct entry *entry_j = file2->entries[j];
+
+      /* Search whether it approximately occurs in file1.  */
+      double best_i_similarity;
+      entry_index_t best_i =
+        find_most_similar (mapping->ctx, entry_j, false, file1,
+                           mapping->index_mapping, &best_i_similarity);
+      if (best_i_similarity >= FSTRCMP_THRESHOLD)
+        {
+          /* Found a similar entry in file1.  */
+          struct entry *entry_i = file1->entries[best_i];
+          /* Search whether it approximately occurs in file2 at index j.  */
+          double best_j_similarity;
+          entry_index_t best_j =
+            find_most_similar (mapping->ctx, entry_i, true, file2,
+                               mapping->index_mapping_reverse,
+                               &best_j_similarity);
+          if (best_j_similarity >= FSTRCMP_THRESHOLD && best_j == j)
+            {
+              mapping->index_mapping_reverse[j] = best_i;
+              mapping->index_mapping[best_i] = j;
+            }
+        }
+      if (mapping->index_mapping_reverse[j] < -1)
+        /* It does not approximately occur in FILE1.
+           Remember it, for next time.  */
+        mapping->index_mapping_reverse[j] = -1;
+    }
+  return mapping->index_mapping_reverse[j];
+}
+
+/* Compute a mapping (correspondence) between entries of FILE1 and of FILE2.
+   The correspondence also takes into account small modifications; i.e. the
+   indicated relation is not equality of entries but best-match similarity
+   of entries.
+   If FULL is true, the maximum of matching is done up-front.  If it is false,
+   it is done in a lazy way through the functions entries_mapping_get and
+   entries_mapping_reverse_get.
+   Return the result in *RESULT.  */
+static void
+compute_mapping (struct merge_context *ctx,
+                 struct changelog_file *file1, struct changelog_file *file2,
+                 bool full,
+                 struct entries_mapping *result)
+{
+  /* Mapping from indices in file1 to indices in file2.  */
+  entry_index_t *index_mapping;
+  /* Mapping from indices in file2 to indices in file1.  */
+  entry_index_t *index_mapping_reverse;
+  size_t n1 = file1->num_entries;
+  size_t n2 = file2->num_entries;
+  entry_index_t i, j;
+
+  index_mapping = XNMALLOC (n1, entry_index_t);
+  for (i = 0; i < n1; i++)
+    index_mapping[i] = -2;
+
+  index_mapping_reverse = XNMALLOC (n2, entry_index_t);
+  for (j = 0; j < n2; j++)
+    index_mapping_reverse[j] = -2;
+
+  /* Find the exact correspondences.  The occurrences of each entry are
+     paired from the end of the files: the last occurrence in file1 with the
+     last occurrence in file2, the one before it with the one before it, and
+     so on.  Unpaired occurrences of the same entry are left without mapping.
+     To this effect, bucket the positions in file2 by entry id, in descending
+     order (a counting sort), and consume each bucket while walking file1
+     backwards.  */
+  {
+    size_t num_ids = gl_list_size (ctx->interned_entries);
+    /* For each id, the start of its bucket in POSITIONS, and then the next
+       position to consume.  */
+    size_t *bucket_next = XNMALLOC (num_ids + 1, size_t);
+    size_t *bucket_end = XNMALLOC (num_ids, size_t);
+    entry_index_t *positions = XNMALLOC (n2, entry_index_t);
+    size_t id;
+
+    for (id = 0; id <= num_ids; id++)
+      bucket_next[id] = 0;
+    for (j = 0; j < n2; j++)
+      bucket_next[file2->entry_ids[j] + 1]++;
+    for (id = 0; id < num_ids; id++)
+      {
+        bucket_next[id + 1] += bucket_next[id];
+        bucket_end[id] = bucket_next[id];
+      }
+    for (j = n2 - 1; j >= 0; j--)
+      positions[bucket_end[file2->entry_ids[j]]++] = j;
+
+    for (i = n1 - 1; i >= 0; i--)
+      {
+        id = file1->entry_ids[i];
+        if (bucket_next[id] < bucket_end[id])
+          {
+            j = positions[bucket_next[id]++];
+            index_mapping[i] = j;
+            index_mapping_reverse[j] = i;
+          }
+      }
+
+    free (positions);
+    free (bucket_end);
+    free (bucket_next);
+  }
+
+  result->ctx = ctx;
+  result->file1 = file1;
+  result->file2 = file2;
+  result->index_mapping = index_mapping;
+  result->index_mapping_reverse = index_mapping_reverse;
+
+  if (full)
+    for (i = n1 - 1; i >= 0; i--)
+      entries_mapping_get (result, i);
+}
+
+/* Free the memory held by a mapping.  */
+static void
+entries_mapping_free (struct entries_mapping *mapping)
+{
+  free (mapping->index_mapping);
+  free (mapping->index_mapping_reverse);
+}
+
+/* An "edit" is a textual modification performed by the user, that needs to
+   be applied to the other file.  */
+enum edit_type
+{
+  /* Some consecutive entries were added.  */
+  ADDITION,
+  /* Some consecutive entries were removed; some other consecutive entries
+     were added at the same position.  (Not necessarily the same number of
+     entries.)  */
+  CHANGE,
+  /* Some consecutive entries were removed.  */
+  REMOVAL
+};
+
+/* This structure represents an edit.  */
+struct edit
+{
+  enum edit_type type;
+  /* Range of indices into the entries of FILE1.  */
+  entry_index_t i1, i2; /* first, last index; only used for CHANGE, REMOVAL */
+  /* Range of indices into the entries of FILE2.  */
+  entry_index_t j1, j2; /* first, last index; only used for ADDITION, CHANGE */
+};
+
+/* This structure represents the differences from one file, FILE1, to another
+   file, FILE2.  */
+struct differences
+{
+  /* An array mapping FILE1 indices to FILE2 indices (or -1 when the entry
+     from FILE1 is not found in FILE2).  */
+  entry_index_t *index_mapping;
+  /* An array mapping FILE2 indices to FILE1 indices (or -1 when the entry
+     from FILE2 is not found in FILE1).  */
+  entry_index_t *index_mapping_reverse;
+  /* The edits that transform FILE1 into FILE2.  */
+  size_t num_edits;
+  struct edit **edits;
+};
+
+/* Import the difference detection algorithm from GNU diff.  */
+#define ELEMENT entry_id_t
+#define EQUAL(id1, id2) ((id1) == (id2))
+#define OFFSET entry_index_t
+#define EXTRA_CONTEXT_FIELDS \
+  struct merge_context *merge; \
+  entry_index_t *index_mapping; \
+  entry_index_t *index_mapping_reverse;
+#define NOTE_DELETE(ctxt, xoff) \
+  ctxt->index_mapping[xoff] = -1
+#define NOTE_INSERT(ctxt, yoff) \
+  ctxt->index_mapping_reverse[yoff] = -1
+#define EARLY_ABORT(ctxt) \
+  budget_exhausted (ctxt->merge, &ctxt->merge->stats->degraded_diff)
+#include "diffseq.h"
+
+/* Compute the differences between the entries of FILE1 and the entries of
+   FILE2.  */
+static void
+compute_differences (struct merge_context *ctx,
+                     struct changelog_file *file1, struct changelog_file *file2,
+                     struct differences *result)
+{
+  /* Unlike compute_mapping, which mostly ignores the order of the entries and
+     therefore works well when some entries are permuted, here we use the order.
+     I think this is needed in order to distinguish changes from
+     additions+removals; I don't know how to say what is a "change" if the
+     files are considered as unordered sets of entries.  */
+  struct context ctxt;
+  size_t n1 = file1->num_entries;
+  size_t n2 = file2->num_entries;
+  entry_index_t i;
+  entry_index_t j;
+  gl_list_t /* <struct edit *> */ edits;
+
+  ctxt.merge = ctx;
+  ctxt.xvec = file1->entry_ids;
+  ctxt.yvec = file2->entry_ids;
+  ctxt.index_mapping = XNMALLOC (n1, entry_index_t);
+  for (i = 0; i < n1; i++)
+    ctxt.index_mapping[i] = 0;
+  ctxt.index_mapping_reverse = XNMALLOC (n2, entry_index_t);
+  for (j = 0; j < n2; j++)
+    ctxt.index_mapping_reverse[j] = 0;
+  ctxt.fdiag = XNMALLOC (2 * (n1 + n2 + 3), entry_index_t) + n2 + 1;
+  ctxt.bdiag = ctxt.fdiag + n1 + n2 + 3;
+  /* split_changelog_file ensures that this doesn't overflow.  */
+  ASSERT (n1 <= ENTRY_COUNT_MAX && n2 <= ENTRY_COUNT_MAX);
+  ctxt.too_expensive = n1 + n2;
+
+  /* Store in ctxt.index_mapping and ctxt.index_mapping_reverse a -1 for
+     each removed or added entry.  */
+  if (compareseq (0, n1, 0, n2, 0, &ctxt))
+    {
+      /* The time budget was used up.  Keep only the common prefix and the
+         common suffix, and consider everything in between as changed.  */
+      size_t prefix;
+      size_t suffix;
+
+      for (prefix = 0;
+           prefix < n1 && prefix < n2
+           && file1->entry_ids[prefix] == file2->entry_ids[prefix];
+           prefix++)
+        ;
+      for (suffix = 0;
+           suffix < n1 - prefix && suffix < n2 - prefix
+           && file1->entry_ids[n1 - 1 - suffix] == file2->entry_ids[n2 - 1 - suffix];
+           suffix++)
+        ;
+      for (i = 0; i < n1; i++)
+        ctxt.index_mapping[i] = (i < prefix || i >= n1 - suffix ? 0 : -1);
+      for (j = 0; j < n2; j++)
+        ctxt.index_mapping_reverse[j] = (j < prefix || j >= n2 - suffix ? 0 : -1);
+    }
+  free (ctxt.fdiag - (n2 + 1));
+
+  /* Complete the index_mapping and index_mapping_reverse arrays.  */
+  i = 0;
+  j = 0;
+  while (i < n1 || j < n2)
+    {
+      while (i < n1 && ctxt.index_mapping[i] < 0)
+        i++;
+      while (j < n2 && ctxt.index_mapping_reverse[j] < 0)
+        j++;
+      ASSERT ((i < n1) == (j < n2));
+      if (i == n1 && j == n2)
+        break;
+      ctxt.index_mapping[i] = j;
+      ctxt.index_mapping_reverse[j] = i;
+      i++;
+      j++;
+    }
+
+  /* Create the edits.  */
+  edits = gl_list_create_empty (GL_ARRAY_LIST, NULL, NULL, NULL, true);
+  i = 0;
+  j = 0;
+  while (i < n1 || j < n2)
+    {
+      if (i == n1)
+        {
+          struct edit *e;
+          ASSERT (j < n2);
+          e = XMALLOC (struct edit);
+          e->type = ADDITION;
+          e->j1 = j;
+          e->j2 = n2 - 1;
+          gl_list_add_last (edits, e);
+          break;
+        }
+      if (j == n2)
+        {
+          struct edit *e;
+          ASSERT (i < n1);
+          e = XMALLOC (struct edit);
+          e->type = REMOVAL;
+          e->i1 = i;
+          e->i2 = n1 - 1;
+          gl_list_add_last (edits, e);
+          break;
+        }
+      if (ctxt.index_mapping[i] >= 0)
+        {
+          if (ctxt.index_mapping_reverse[j] >= 0)
+            {
+              ASSERT (ctxt.index_mapping[i] == j);
+              ASSERT (ctxt.index_mapping_reverse[j] == i);
+              i++;
+              j++;
+            }
+          else
+            {
+              struct edit *e;
+              ASSERT (ctxt.index_mapping_reverse[j] < 0);
+              e = XMALLOC (struct edit);
+              e->type = ADDITION;
+              e->j1 = j;
+              do
+                j++;
+              while (j < n2 && ctxt.index_mapping_reverse[j] < 0);
+              e->j2 = j - 1;
+              gl_list_add_last (edits, e);
+            }
+        }
+      else
+        {
+          if (ctxt.index_mapping_reverse[j] >= 0)
+            {
+              struct edit *e;
+              ASSERT (ctxt.index_mapping[i] < 0);
+              e = XMALLOC (struct edit);
+              e->type = REMOVAL;
+              e->i1 = i;
+              do
+                i++;
+              while (i < n1 && ctxt.index_mapping[i] < 0);
+              e->i2 = i - 1;
+              gl_list_add_last (edits, e);
+            }
+          else
+            {
+              struct edit *e;
+              ASSERT (ctxt.index_mapping[i] < 0);
+              ASSERT (ctxt.index_mapping_reverse[j] < 0);
+              e = XMALLOC (struct edit);
+              e->type = CHANGE;
+              e->i1 = i;
+              do
+                i++;
+              while (i < n1 && ctxt.index_mapping[i] < 0);
+              e->i2 = i - 1;
+              e->j1 = j;
+              do
+                j++;
+              while (j < n2 && ctxt.index_mapping_reverse[j] < 0);
+              e->j2 = j - 1;
+              gl_list_add_last (edits, e);
+            }
+        }
+    }
+
+  result->index_mapping = ctxt.index_mapping;
+  result->index_mapping_reverse = ctxt.index_mapping_reverse;
+  result->num_edits = gl_list_size (edits);
+  result->edits = XNMALLOC (result->num_edits, struct edit *);
+  {
+    size_t index = 0;
+    gl_list_iterator_t iter = gl_list_iterator (edits);
+    const void *elt;
+    gl_list_node_t node;
+    while (gl_list_iterator_next (&iter, &elt, &node))
+      result->edits[index++] = (struct edit *) elt;
+    gl_list_iterator_free (&iter);
+    ASSERT (index == result->num_edits);
+  }
+  gl_list_free (edits);
+}
+
+/* Free the memory held by differences.  */
+static void
+differences_free (struct differences *diffs)
+{
+  size_t e;
+
+  for (e = 0; e < diffs->num_edits; e++)
+    free (diffs->edits[e]);
+  free (diffs->edits);
+  free (diffs->index_mapping);
+  free (diffs->index_mapping_reverse);
+}
+
+/* Return the end a paragraph.
+   ENTRY is an entry.
+   OFFSET is an offset into the entry, OFFSET <= ENTRY->length.
+   Return the offset of the end of paragraph, as an offset <= ENTRY->length;
+   it is the start of a blank line or the end of the entry.  */
+static size_t
+find_paragraph_end (const struct entry *entry, size_t offset)
+{
+  const char *string = entry->string;
+  size_t length = entry->length;
+
+  for (;;)
+    {
+      const char *nl = memchr (string + offset, '\n', length - offset);
+      if (nl == NULL)
+        return length;
+      offset = (nl - string) + 1;
+      if (offset < length && string[offset] == '\n')
+        return offset;
+    }
+}
+
+/* Split a merged entry.
+   Given an old entry of the form
+       TITLE
+       BODY
+   and a new entry of the form
+       TITLE
+       BODY1
+       BODY'
+   where the two titles are the same and BODY and BODY' are very similar,
+   this computes two new entries
+       TITLE
+       BODY1
+   and
+       TITLE
+       BODY'
+   and returns true.
+   If the entries don't have this form, it returns false.
+   The outcome is remembered in CTX.  */
+static bool
+try_split_merged_entry (struct merge_context *ctx,
+                        const struct entry *old_entry,
+                        const struct entry *new_entry,
+                        struct entry *new_split[2])
+{
+  size_t old_title_len;
+  size_t new_title_len;
+  struct entry old_body;
+  struct entry new_body;
+  size_t best_split_offset;
+  double best_similarity;
+  size_t split_offset;
+  struct pair_memo *memo;
+  size_t comparisons;
+
+  if (old_entry->sketch != NULL && new_entry->sketch != NULL)
+    {
+      /* The sketches know the titles.  */
+      if (!(old_entry->sketch->title_length == new_entry->sketch->title_length
+            && old_entry->sketch->title_hash == new_entry->sketch->title_hash))
+        return false;
+      old_title_len = old_entry->sketch->title_length;
+      new_title_len = new_entry->sketch->title_length;
+    }
+  else
+    {
+      old_title_len = find_paragraph_end (old_entry, 0);
+      new_title_len = find_paragraph_end (new_entry, 0);
+    }
+
+  /* Same title? */
+  if (!(old_title_len == new_title_len
+        && memcmp (old_entry->string, new_entry->string, old_title_len) == 0))
+    return false;
+
+  memo = pair_memo_get (ctx, old_entry, new_entry);
+  if (memo != NULL && memo->have_split)
+    {
+      ctx->stats->similarity_avoided += memo->split_comparisons;
+      if (memo->split[0] == NULL)
+        return false;
+      new_split[0] = memo->split[0];
+      new_split[1] = memo->split[1];
+      return true;
+    }
+
+  old_body.string = old_entry->string + old_title_len;
+  old_body.length = old_entry->length - old_title_len;
+  old_body.id = NO_ENTRY_ID;
+  old_body.sketch = NULL;
+  new_body.id = NO_ENTRY_ID;
+  new_body.sketch = NULL;
+
+  /* Determine where to split the new entry.
+     This is done by maximizing the similarity between BODY and BODY'.  */
+  best_split_offset = split_offset = new_title_len;
+  best_similarity = 0.0;
+  comparisons = 0;
+  for (;;)
+    {
+      double similarity;
+
+      if (budget_exhausted (ctx, &ctx->stats->degraded_split))
+        /* No time left.  Don't split.  */
+        return false;
+
+      new_body.string = new_entry->string + split_offset;
+      new_body.length = new_entry->length - split_offset;
+      similarity =
+        entry_fstrcmp (ctx, &old_body, &new_body, best_similarity);
+      comparisons++;
+      if (similarity > best_similarity)
+        {
+          best_split_offset = split_offset;
+          best_similarity = similarity;
+        }
+      if (best_similarity == 1.0)
+        /* It cannot get better.  */
+        break;
+
+      if (split_offset < new_entry->length)
+        split_offset = find_paragraph_end (new_entry, split_offset + 1);
+      else
+        break;
+    }
+
+  /* BODY' should not be empty, and a certain similarity between BODY and
+     BODY' is required.  */
+  if (best_split_offset == new_entry->length
+      || best_similarity < FSTRCMP_STRICTER_THRESHOLD)
+    {
+      new_split[0] = NULL;
+      new_split[1] = NULL;
+    }
+  else
+    {
+      ASSERT (new_entry->string[best_split_offset] == '\n');
+      new_split[0] =
+        entry_create (ctx, new_entry->string, best_split_offset + 1, NULL, 0);
+      new_split[1] =
+        entry_create (ctx, new_entry->string, new_title_len,
+                      new_entry->string + best_split_offset,
+                      new_entry->length - best_split_offset);
+    }
+
+  /* The comparisons above don't use the memos, but don't rely on it.  */
+  memo = pair_memo_get (ctx, old_entry, new_entry);
+  if (memo != NULL)
+    {
+      memo->have_split = true;
+      memo->split[0] = new_split[0];
+      memo->split[1] = new_split[1];
+      memo->split_comparisons = comparisons;
+    }
+  return new_split[0] != NULL;
+}
+
+/* A growable output buffer.  */
+struct output
+{
+  char *contents;
+  size_t length;
+  size_t allocated;
+};
+
+/* Append LENGTH bytes at STRING to OUT.  */
+static void
+output_append (struct output *out, const char *string, size_t length)
+{
+  if (length > out->allocated - out->length)
+    {
+      out->allocated = 2 * out->allocated + length;
+      out->contents = (char *) xrealloc (out->contents, out->allocated);
+    }
+  memcpy (out->contents + out->length, string, length);
+  out->length += length;
+}
+
+/* Write the contents of an entry to OUT.  */
+static void
+entry_write (struct output *out, const struct entry *entry)
+{
+  if (entry->length > 0)
+    output_append (out, entry->string, entry->length);
+}
+
+/* This structure represents a conflict.
+   A conflict can occur for various reasons.  */
+struct conflict
+{
+  /* Parts from the ancestor file.  */
+  size_t num_old_entries;
+  struct entry **old_entries;
+  /* Parts of the modified file.  */
+  size_t num_modified_entries;
+  struct entry **modified_entries;
+};
+
+/* Free a conflict.  */
+static void
+conflict_free (struct conflict *c)
+{
+  free (c->old_entries);
+  free (c->modified_entries);
+  free (c);
+}
+
+/* Write a conflict to OUT, including markers.  */
+static void
+conflict_write (struct output *out, struct conflict *c)
+{
+  size_t i;
+
+  /* Use the same syntax as git's default merge driver.
+     Don't indent the contents of the entries (with things like ">" or "-"),
+     otherwise the user needs more textual editing to resolve the conflict.  */
+  output_append (out, "<<<<<<<\n", 8);
+  for (i = 0; i < c->num_old_entries; i++)
+    entry_write (out, c->old_entries[i]);
+  output_append (out, "=======\n", 8);
+  for (i = 0; i < c->num_modified_entries; i++)
+    entry_write (out, c->modified_entries[i]);
+  output_append (out, ">>>>>>>\n", 8);
+}
+
+/* The merged file, while it is being built.  */
+struct merge_result
+{
+  /* The entries, in order.  Entries that were removed are replaced with
+     empty_entry.  */
+  gl_list_t /* <struct entry *> */ entries;
+  /* Array of pointers into ENTRIES, one for each entry of the mainstream
+     file.  */
+  gl_list_node_t *entries_pointers;
+  /* The conflicts.  */
+  gl_list_t /* <struct conflict *> */ conflicts;
+};
+
+/* Return the entry that is currently at the position of entry K of the
+   mainstream file in RESULT.  This is the entry of the mainstream file,
+   unless the edits of another modified file have already replaced it.  */
+static const struct entry *
+result_entry_at (struct merge_result *result, entry_index_t k)
+{
+  return (const struct entry *)
+    gl_list_node_value (result->entries, result->entries_pointers[k]);
+}
+
+/* Apply the differences DIFFS, from ANCESTOR_FILE to MODIFIED_FILE, to
+   RESULT.  MAPPING is the mapping from ANCESTOR_FILE to MAINSTREAM_FILE.
+   If STOP_AT_CONFLICT, stop after the first edit that produces a
+   conflict.  */
+static void
+apply_differences (struct merge_context *ctx,
+                   struct changelog_file *ancestor_file,
+                   struct changelog_file *mainstream_file,
+                   struct entries_mapping *mapping,
+                   struct changelog_file *modified_file,
+                   struct differences *diffs,
+                   bool split_merged_entry,
+                   bool stop_at_conflict,
+                   struct merge_result *result)
+{
+  size_t e;
+  for (e = 0; e < diffs->num_edits; e++)
+    {
+      struct edit *edit = diffs->edits[e];
+
+      if (stop_at_conflict && gl_list_size (result->conflicts) > 0)
+        break;
+
+      switch (edit->type)
+        {
+        case ADDITION:
+          if (edit->j1 == 0)
+            {
+              /* An addition to the top of modified_file.
+                 Apply it to the top of mainstream_file.  */
+              ssize_t j;
+              for (j = edit->j2; j >= edit->j1; j--)
+                {
+                  struct entry *added_entry = modified_file->entries[j];
+                  gl_list_add_first (result->entries, added_entry);
+                }
+            }
+          else
+            {
+              ssize_t i_before;
+              ssize_t i_after;
+              ssize_t k_before;
+              ssize_t k_after;
+              i_before = diffs->index_mapping_reverse[edit->j1 - 1];
+              ASSERT (i_before >= 0);
+              i_after = (edit->j2 + 1 == modified_file->num_entries
+                         ? ancestor_file->num_entries
+                         : diffs->index_mapping_reverse[edit->j2 + 1]);
+              ASSERT (i_after >= 0);
+              ASSERT (i_after == i_before + 1);
+              /* An addition between ancestor_file->entries[i_before] and
+                 ancestor_file->entries[i_after].  See whether these two
+                 entries still exist in mainstream_file and are still
+                 consecutive.  */
+              k_before = entries_mapping_get (mapping, i_before);
+              k_after = (i_after == ancestor_file->num_entries
+                         ? mainstream_file->num_entries
+                         : entries_mapping_get (mapping, i_after));
+              if (k_before >= 0 && k_after >= 0 && k_after == k_before + 1)
+                {
+                  /* Yes, the entry before and after are still neighbours
+                     in mainstream_file.  Apply the addition between
+                     them.  */
+                  if (k_after == mainstream_file->num_entries)
+                    {
+                      size_t j;
+                      for (j = edit->j1; j <= edit->j2; j++)
+                        {
+                          struct entry *added_entry = modified_file->entries[j];
+                          gl_list_add_last (result->entries, added_entry);
+                        }
+                    }
+                  else
+                    {
+                      gl_list_node_t node_k_after = result->entries_pointers[k_after];
+                      size_t j;
+                      for (j = edit->j1; j <= edit->j2; j++)
+                        {
+                          struct entry *added_entry = modified_file->entries[j];
+                          gl_list_add_before (result->entries, node_k_after, added_entry);
+                        }
+                    }
+                }
+              else
+                {
+                  /* It's not clear where the additions should be applied.
+                     Let the user decide.  */
+                  struct conflict *c = XMALLOC (struct conflict);
+                  size_t j;
+                  c->num_old_entries = 0;
+                  c->old_entries = NULL;
+                  c->num_modified_entries = edit->j2 - edit->j1 + 1;
+                  c->modified_entries =
+                    XNMALLOC (c->num_modified_entries, struct entry *);
+                  for (j = edit->j1; j <= edit->j2; j++)
+                    c->modified_entries[j - edit->j1] = modified_file->entries[j];
+                  gl_list_add_last (result->conflicts, c);
+                }
+            }
+          break;
+        case REMOVAL:
+          {
+            /* Apply the removals one by one.  */
+            size_t i;
+            for (i = edit->i1; i <= edit->i2; i++)
+              {
+                struct entry *removed_entry = ancestor_file->entries[i];
+                ssize_t k = entries_mapping_get (mapping, i);
+                if (k >= 0
+                    && entry_equals (removed_entry,
+                                     result_entry_at (result, k)))
+                  {
+                    /* The entry to be removed still exists in
+                       mainstream_file.  Remove it.  */
+                    gl_list_node_set_value (result->entries,
+                                            result->entries_pointers[k],
+                                            &ctx->empty_entry);
+                  }
+                else
+                  {
+                    /* The entry to be removed was already removed or was
+                       modified.  This is a conflict.  */
+                    struct conflict *c = XMALLOC (struct conflict);
+                    c->num_old_entries = 1;
+                    c->old_entries =
+                      XNMALLOC (c->num_old_entries, struct entry *);
+                    c->old_entries[0] = removed_entry;
+                    c->num_modified_entries = 0;
+                    c->modified_entries = NULL;
+                    gl_list_add_last (result->conflicts, c);
+                  }
+              }
+          }
+          break;
+        case CHANGE:
+          {
+            bool done = false;
+            /* When the user usually merges entries from the same day,
+               and this edit is at the top of the file:  */
+            if (split_merged_entry && edit->j1 == 0)
+              {
+                /* Test whether the change is "simple merged", i.e. whether
+                   it consists of additions, followed by an augmentation of
+                   the first changed entry, followed by small changes of the
+                   remaining entries:
+                     entry_1
+                     entry_2
+                     ...
+                     entry_n
+                   are mapped to
+                     added_entry
+                     ...
+                     added_entry
+                     augmented_entry_1
+                     modified_entry_2
+                     ...
+                     modified_entry_n.  */
+                if (edit->i2 - edit->i1 <= edit->j2 - edit->j1)
+                  {
+                    struct entry *split[2];
+                    bool simple_merged =
+                      try_split_merged_entry (ctx, ancestor_file->entries[edit->i1],
+                                              modified_file->entries[edit->i1 + edit->j2 - edit->i2],
+                                              split);
+                    if (simple_merged)
+                      {
+                        size_t i;
+                        for (i = edit->i1 + 1; i <= edit->i2; i++)
+                          if (entry_fstrcmp (ctx, ancestor_file->entries[i],
+                                             modified_file->entries[i + edit->j2 - edit->i2],
+                                             FSTRCMP_THRESHOLD)
+                              < FSTRCMP_THRESHOLD)
+                            {
+                              simple_merged = false;
+                              break;
+                            }
+                      }
+                    if (simple_merged)
+                      {
+                        /* Apply the additions at the top of modified_file.
+                           Apply each of the single-entry changes
+                           separately.  */
+                        size_t num_changed = edit->i2 - edit->i1 + 1; /* > 0 */
+                        size_t num_added = (edit->j2 - edit->j1 + 1) - num_changed;
+                        ssize_t j;
+                        /* First part of the split modified_file->entries[edit->j2 - edit->i2 + edit->i1]:  */
+                        gl_list_add_first (result->entries, split[0]);
+                        /* The additions.  */
+                        for (j = edit->j1 + num_added - 1; j >= edit->j1; j--)
+                          {
+                            struct entry *added_entry = modified_file->entries[j];
+                            gl_list_add_first (result->entries, added_entry);
+                          }
+                        /* Now the single-entry changes.  */
+                        for (j = edit->j1 + num_added; j <= edit->j2; j++)
+                          {
+                            struct entry *changed_entry =
+                              (j == edit->j1 + num_added
+                               ? split[1]
+                               : modified_file->entries[j]);
+                            size_t i = j + edit->i2 - edit->j2;
+                            ssize_t k = entries_mapping_get (mapping, i);
+                            if (k >= 0
+                                && entry_equals (ancestor_file->entries[i],
+                                                 result_entry_at (result, k)))
+                              {
+                                gl_list_node_set_value (result->entries,
+                                                        result->entries_pointers[k],
+                                                        changed_entry);
+                              }
+                            else if (!entry_equals (ancestor_file->entries[i],
+                                                    changed_entry))
+                              {
+                                struct conflict *c = XMALLOC (struct conflict);
+                                c->num_old_entries = 1;
+                                c->old_entries =
+                                  XNMALLOC (c->num_old_entries, struct entry *);
+                                c->old_entries[0] = ancestor_file->entries[i];
+                                c->num_modified_entries = 1;
+                                c->modified_entries =
+                                  XNMALLOC (c->num_modified_entries, struct entry *);
+                                c->modified_entries[0] = changed_entry;
+                                gl_list_add_last (result->conflicts, c);
+                              }
+                          }
+                        done = true;
+                      }
+                  }
+              }
+            if (!done)
+              {
+                bool simple;
+                /* Test whether the change is "simple", i.e. whether it
+                   consists of small changes to the old ChangeLog entries
+                   and additions before them:
+                     entry_1
+                     ...
+                     entry_n
+                   are mapped to
+                     added_entry
+                     ...
+                     added_entry
+                     modified_entry_1
+                     ...
+                     modified_entry_n.  */
+                if (edit->i2 - edit->i1 <= edit->j2 - edit->j1)
+                  {
+                    size_t i;
+                    simple = true;
+                    for (i = edit->i1; i <= edit->i2; i++)
+                      if (entry_fstrcmp (ctx, ancestor_file->entries[i],
+                                         modified_file->entries[i + edit->j2 - edit->i2],
+                                         FSTRCMP_THRESHOLD)
+                          < FSTRCMP_THRESHOLD)
+                        {
+                          simple = false;
+                          break;
+                        }
+                  }
+                else
+                  simple = false;
+                if (simple)
+                  {
+                    /* Apply the additions and each of the single-entry
+                       changes separately.  */
+                    size_t num_changed = edit->i2 - edit->i1 + 1; /* > 0 */
+                    size_t num_added = (edit->j2 - edit->j1 + 1) - num_changed;
+                    if (edit->j1 == 0)
+                      {
+                        /* A simple change at the top of modified_file.
+                           Apply it to the top of mainstream_file.  */
+                        ssize_t j;
+                        for (j = edit->j1 + num_added - 1; j >= edit->j1; j--)
+                          {
+                            struct entry *added_entry = modified_file->entries[j];
+                            gl_list_add_first (result->entries, added_entry);
+                          }
+                        for (j = edit->j1 + num_added; j <= edit->j2; j++)
+                          {
+                            struct entry *changed_entry = modified_file->entries[j];
+                            size_t i = j + edit->i2 - edit->j2;
+                            ssize_t k = entries_mapping_get (mapping, i);
+                            if (k >= 0
+                                && entry_equals (ancestor_file->entries[i],
+                                                 result_entry_at (result, k)))
+                              {
+                                gl_list_node_set_value (result->entries,
+                                                        result->entries_pointers[k],
+                                                        changed_entry);
+                              }
+                            else
+                              {
+                                struct conflict *c;
+                                ASSERT (!entry_equals (ancestor_file->entries[i],
+                                                       changed_entry));
+                                c = XMALLOC (struct conflict);
+                                c->num_old_entries = 1;
+                                c->old_entries =
+                                  XNMALLOC (c->num_old_entries, struct entry *);
+                                c->old_entries[0] = ancestor_file->entries[i];
+                                c->num_modified_entries = 1;
+                                c->modified_entries =
+                                  XNMALLOC (c->num_modified_entries, struct entry *);
+                                c->modified_entries[0] = changed_entry;
+                                gl_list_add_last (result->conflicts, c);
+                              }
+                          }
+                        done = true;
+                      }
+                    else
+                      {
+                        ssize_t i_before;
+                        ssize_t k_before;
+                        bool linear;
+                        i_before = diffs->index_mapping_reverse[edit->j1 - 1];
+                        ASSERT (i_before >= 0);
+                        /* A simple change after ancestor_file->entries[i_before].
+                           See whether this entry and the following num_changed
+                           entries still exist in mainstream_file and are still
+                           consecutive.  */
+                        k_before = entries_mapping_get (mapping, i_before);
+                        linear = (k_before >= 0);
+                        if (linear)
+                          {
+                            size_t i;
+                            for (i = i_before + 1; i <= i_before + num_changed; i++)
+                              if (entries_mapping_get (mapping, i) != k_before + (i - i_before))
+                                {
+                                  linear = false;
+                                  break;
+                                }
+                          }
+                        if (linear)
+                          {
+                            gl_list_node_t node_for_insert =
+                              result->entries_pointers[k_before + 1];
+                            ssize_t j;
+                            for (j = edit->j1 + num_added - 1; j >= edit->j1; j--)
+                              {
+                                struct entry *added_entry = modified_file->entries[j];
+                                gl_list_add_before (result->entries, node_for_insert, added_entry);
+                              }
+                            for (j = edit->j1 + num_added; j <= edit->j2; j++)
+                              {
+                                struct entry *changed_entry = modified_file->entries[j];
+                                size_t i = j + edit->i2 - edit->j2;
+                                ssize_t k = entries_mapping_get (mapping, i);
+                                ASSERT (k >= 0);
+                                if (entry_equals (ancestor_file->entries[i],
+                                                  result_entry_at (result, k)))
+                                  {
+                                    gl_list_node_set_value (result->entries,
+                                                            result->entries_pointers[k],
+                                                            changed_entry);
+                                  }
+                                else
+                                  {
+                                    struct conflict *c;
+                                    ASSERT (!entry_equals (ancestor_file->entries[i],
+                                                           changed_entry));
+                                    c = XMALLOC (struct conflict);
+                                    c->num_old_entries = 1;
+                                    c->old_entries =
+                                      XNMALLOC (c->num_old_entries, struct entry *);
+                                    c->old_entries[0] = ancestor_file->entries[i];
+                                    c->num_modified_entries = 1;
+                                    c->modified_entries =
+                                      XNMALLOC (c->num_modified_entries, struct entry *);
+                                    c->modified_entries[0] = changed_entry;
+                                    gl_list_add_last (result->conflicts, c);
+                                  }
+                              }
+                            done = true;
+                          }
+                      }
+                  }
+                else
+                  {
+                    /* A big change.
+                       See whether the num_changed entries still exist
+                       unchanged in mainstream_file and are still
+                       consecutive.  */
+                    ssize_t i_first;
+                    ssize_t k_first;
+                    bool linear_unchanged;
+                    i_first = edit->i1;
+                    k_first = entries_mapping_get (mapping, i_first);
+                    linear_unchanged =
+                      (k_first >= 0
+                       && entry_equals (ancestor_file->entries[i_first],
+                                        result_entry_at (result, k_first)));
+                    if (linear_unchanged)
+                      {
+                        size_t i;
+                        for (i = i_first + 1; i <= edit->i2; i++)
+                          if (!(entries_mapping_get (mapping, i) == k_first + (i - i_first)
+                                && entry_equals (ancestor_file->entries[i],
+                                                 result_entry_at (result, entries_mapping_get (mapping, i)))))
+                            {
+                              linear_unchanged = false;
+                              break;
+                            }
+                      }
+                    if (linear_unchanged)
+                      {
+                        gl_list_node_t node_for_insert =
+                          result->entries_pointers[k_first];
+                        ssize_t j;
+                        size_t i;
+                        for (j = edit->j2; j >= edit->j1; j--)
+                          {
+                            struct entry *new_entry = modified_file->entries[j];
+                            gl_list_add_before (result->entries, node_for_insert, new_entry);
+                          }
+                        for (i = edit->i1; i <= edit->i2; i++)
+                          {
+                            ssize_t k = entries_mapping_get (mapping, i);
+                            ASSERT (k >= 0);
+                            ASSERT (entry_equals (ancestor_file->entries[i],
+                                                  result_entry_at (result, k)));
+                            gl_list_node_set_value (result->entries,
+                                                    result->entries_pointers[k],
+                                                    &ctx->empty_entry);
+                          }
+                        done = true;
+                      }
+                  }
+              }
+            if (!done)
+              {
+                struct conflict *c = XMALLOC (struct conflict);
+                size_t i, j;
+                c->num_old_entries = edit->i2 - edit->i1 + 1;
+                c->old_entries =
+                  XNMALLOC (c->num_old_entries, struct entry *);
+                for (i = edit->i1; i <= edit->i2; i++)
+                  c->old_entries[i - edit->i1] = ancestor_file->entries[i];
+                c->num_modified_entries = edit->j2 - edit->j1 + 1;
+                c->modified_entries =
+                  XNMALLOC (c->num_modified_entries, struct entry *);
+                for (j = edit->j1; j <= edit->j2; j++)
+                  c->modified_entries[j - edit->j1] = modified_file->entries[j];
+                gl_list_add_last (result->conflicts, c);
+              }
+          }
+          break;
+        }
+    }
+}
+
+/* Return the title of the first entry of a conflict, as a freshly allocated
+   string, and its length in *LENGTHP.  */
+static char *
+conflict_title (const struct conflict *c, size_t *lengthp)
+{
+  const struct entry *entry =
+    (c->num_old_entries > 0 ? c->old_entries[0] : c->modified_entries[0]);
+  size_t length = find_paragraph_end (entry, 0);
+  char *title;
+
+  if (length > 0 && entry->string[length - 1] == '\n')
+    length--;
+  title = XNMALLOC (length + 1, char);
+  memcpy (title, entry->string, length);
+  title[length] = '\0';
+  *lengthp = length;
+  return title;
+}
+
+void
+changelog_merge_options_init (struct changelog_merge_options *options)
+{
+  options->split_merged_entry = true;
+  options->time_budget = -1;
+  options->probe = false;
+}
+
+/* Compare two buffers for equality.  */
+static bool
+buffer_equals (const struct changelog_buffer *buffer1,
+               const struct changelog_buffer *buffer2)
+{
+  return (buffer1->length == buffer2->length
+          && (buffer1->length == 0
+              || memcmp (buffer1->contents, buffer2->contents,
+                         buffer1->length) == 0));
+}
+
+enum changelog_merge_trivial
+changelog_merge_trivial (const struct changelog_buffer *ancestor,
+                         const struct changelog_buffer *mainstream,
+                         const struct changelog_buffer *modified,
+                         size_t num_modified,
+                         const struct changelog_buffer **winner)
+{
+  size_t m;
+
+  for (m = 0; m < num_modified; m++)
+    if (!buffer_equals (&modified[m], ancestor))
+      break;
+  if (m == num_modified)
+    {
+      *winner = mainstream;
+      return CHANGELOG_MERGE_MODIFIED_UNCHANGED;
+    }
+
+  if (num_modified == 1 && buffer_equals (mainstream, ancestor))
+    {
+      *winner = &modified[0];
+      return CHANGELOG_MERGE_MAINSTREAM_UNCHANGED;
+    }
+
+  for (m = 0; m < num_modified; m++)
+    if (!buffer_equals (&modified[m], mainstream))
+      break;
+  if (m == num_modified)
+    {
+      *winner = mainstream;
+      return CHANGELOG_MERGE_SAME_CHANGES;
+    }
+
+  return CHANGELOG_MERGE_NOT_TRIVIAL;
+}
+
+int
+changelog_merge (const struct changelog_buffer *ancestor,
+                 const struct changelog_buffer *mainstream,
+                 const struct changelog_buffer *modified,
+                 size_t num_modified,
+                 const struct changelog_merge_options *options,
+                 struct changelog_merge_result *result)
+{
+  struct changelog_merge_options default_options;
+  struct merge_context ctx;
+  struct changelog_file ancestor_file;
+  struct changelog_file mainstream_file;
+  struct changelog_file *modified_files;
+  struct split_job *jobs;
+  size_t num_jobs;
+  size_t j;
+  /* Mapping from indices in ancestor_file to indices in mainstream_file.  */
+  struct entries_mapping mapping;
+  /* Differences from ancestor_file to each of the modified_files.  */
+  struct differences *diffs;
+  size_t num_diffs;
+  struct merge_result merged;
+  struct output out;
+  size_t num_conflicts;
+  size_t m;
+  const struct changelog_buffer *winner;
+  struct timespec phase_start;
+
+  if (options == NULL)
+    {
+      changelog_merge_options_init (&default_options);
+      options = &default_options;
+    }
+
+  memset (&result->stats, 0, sizeof (result->stats));
+  clock_gettime (CLOCK_MONOTONIC, &phase_start);
+  result->contents = NULL;
+  result->length = 0;
+  result->conflict_ends = NULL;
+  result->conflict_title = NULL;
+  result->conflict_title_length = 0;
+
+  /* Shortcut: When some of the files are identical, there is nothing to
+     merge.  */
+  result->stats.trivial =
+    changelog_merge_trivial (ancestor, mainstream, modified, num_modified,
+                             &winner);
+  if (result->stats.trivial != CHANGELOG_MERGE_NOT_TRIVIAL)
+    {
+      if (!options->probe)
+        {
+          result->contents = XNMALLOC (winner->length, char);
+          if (winner->length > 0)
+            memcpy (result->contents, winner->contents, winner->length);
+          result->length = winner->length;
+        }
+      return 0;
+    }
+
+  merge_context_init (&ctx, &result->stats);
+  if (options->time_budget >= 0)
+    budget_start (&ctx, options->time_budget);
+
+  /* Split the files into entries, in parallel.  Then intern the entries,
+     in a fixed order, so that the entry ids don't depend on timing.  */
+  modified_files = XNMALLOC (num_modified, struct changelog_file);
+  num_jobs = 2 + num_modified;
+  jobs = XNMALLOC (num_jobs, struct split_job);
+  jobs[0].buffer = ancestor;
+  jobs[0].result = &ancestor_file;
+  jobs[1].buffer = mainstream;
+  jobs[1].result = &mainstream_file;
+  for (m = 0; m < num_modified; m++)
+    {
+      jobs[2 + m].buffer = &modified[m];
+      jobs[2 + m].result = &modified_files[m];
+    }
+#if ENABLE_THREADS
+  {
+    gl_thread_t *threads = XNMALLOC (num_jobs - 1, gl_thread_t);
+    for (j = 1; j < num_jobs; j++)
+      threads[j - 1] = gl_thread_create (split_job_run, &jobs[j]);
+    split_job_run (&jobs[0]);
+    for (j = 1; j < num_jobs; j++)
+      gl_thread_join (threads[j - 1], NULL);
+    free (threads);
+  }
+#else
+  for (j = 0; j < num_jobs; j++)
+    split_job_run (&jobs[j]);
+#endif
+  for (j = 0; j < num_jobs; j++)
+    if (!jobs[j].ok)
+      {
+        int saved_errno = jobs[j].error;
+        size_t jj;
+        for (jj = 0; jj < num_jobs; jj++)
+          if (jobs[jj].ok)
+            {
+              free (jobs[jj].result->entries);
+              free (jobs[jj].result->storage);
+            }
+        free (jobs);
+        free (modified_files);
+        merge_context_free (&ctx);
+        errno = saved_errno;
+        return -1;
+      }
+  for (j = 0; j < num_jobs; j++)
+    intern_changelog_file (&ctx, jobs[j].result);
+  free (jobs);
+  result->stats.split_time = phase_time (&phase_start);
+
+  /* Compute correspondence between the entries of ancestor_file and of
+     mainstream_file.  */
+  compute_mapping (&ctx, &ancestor_file, &mainstream_file, false, &mapping);
+  (void) entries_mapping_reverse_get; /* avoid gcc "defined but not" warning */
+  result->stats.mapping_time = phase_time (&phase_start);
+
+  /* Compute the result.  For each of the modified_files, compute the
+     differences between the entries of ancestor_file and of it, and apply
+     them.  The edits of the modified files are applied in the order given;
+     therefore additions at the top from later files end up above those from
+     earlier files.  */
+  merged.entries_pointers =
+    XNMALLOC (mainstream_file.num_entries, gl_list_node_t);
+  merged.entries =
+    gl_list_create_empty (GL_LINKED_LIST, entry_equals, entry_hashcode,
+                          NULL, true);
+  {
+    size_t k;
+    for (k = 0; k < mainstream_file.num_entries; k++)
+      merged.entries_pointers[k] =
+        gl_list_add_last (merged.entries, mainstream_file.entries[k]);
+  }
+  merged.conflicts =
+    gl_list_create_empty (GL_ARRAY_LIST, NULL, NULL, NULL, true);
+  diffs = XNMALLOC (num_modified, struct differences);
+  for (num_diffs = 0; num_diffs < num_modified; num_diffs++)
+    {
+      if (options->probe && gl_list_size (merged.conflicts) > 0)
+        break;
+      compute_differences (&ctx, &ancestor_file, &modified_files[num_diffs],
+                           &diffs[num_diffs]);
+      result->stats.diff_time += phase_time (&phase_start);
+      apply_differences (&ctx, &ancestor_file, &mainstream_file, &mapping,
+                         &modified_files[num_diffs], &diffs[num_diffs],
+                         options->split_merged_entry, options->probe, &merged);
+      result->stats.apply_time += phase_time (&phase_start);
+    }
+  num_conflicts = gl_list_size (merged.conflicts);
+
+  if (num_conflicts > 0)
+    result->conflict_title =
+      conflict_title ((struct conflict *) gl_list_get_at (merged.conflicts, 0),
+                      &result->conflict_title_length);
+
+  /* Assemble the output.  */
+  if (!options->probe)
+    {
+      out.contents = NULL;
+      out.length = 0;
+      out.allocated = 0;
+      /* Output the conflicts at the top.  */
+      if (num_conflicts > 0)
+        {
+          size_t i;
+          result->conflict_ends = XNMALLOC (num_conflicts, size_t);
+          for (i = 0; i < num_conflicts; i++)
+            {
+              conflict_write (&out,
+                              (struct conflict *)
+                              gl_list_get_at (merged.conflicts, i));
+              result->conflict_ends[i] = out.length;
+            }
+        }
+      /* Output the modified and unmodified entries, in order.  */
+      {
+        gl_list_iterator_t iter = gl_list_iterator (merged.entries);
+        const void *elt;
+        gl_list_node_t node;
+        while (gl_list_iterator_next (&iter, &elt, &node))
+          entry_write (&out, (const struct entry *) elt);
+        gl_list_iterator_free (&iter);
+      }
+      result->contents = out.contents;
+      result->length = out.length;
+      result->stats.output_time = phase_time (&phase_start);
+    }
+
+  /* Collect statistics.  */
+  result->stats.ancestor_entries = ancestor_file.num_entries;
+  result->stats.mainstream_entries = mainstream_file.num_entries;
+  for (m = 0; m < num_modified; m++)
+    result->stats.modified_entries += modified_files[m].num_entries;
+  for (m = 0; m < num_diffs; m++)
+    {
+      size_t e;
+
+      result->stats.edits += diffs[m].num_edits;
+      for (e = 0; e < diffs[m].num_edits; e++)
+        switch (diffs[m].edits[e]->type)
+          {
+          case ADDITION:
+            result->stats.additions++;
+            break;
+          case REMOVAL:
+            result->stats.removals++;
+            break;
+          case CHANGE:
+            result->stats.changes++;
+            break;
+          }
+    }
+  result->stats.conflicts = num_conflicts;
+
+  /* Clean up.  */
+  {
+    size_t i;
+    for (i = 0; i < num_conflicts; i++)
+      conflict_free ((struct conflict *) gl_list_get_at (merged.conflicts, i));
+  }
+  gl_list_free (merged.conflicts);
+  gl_list_free (merged.entries);
+  free (merged.entries_pointers);
+  for (m = 0; m < num_diffs; m++)
+    differences_free (&diffs[m]);
+  free (diffs);
+  entries_mapping_free (&mapping);
+  for (m = 0; m < num_modified; m++)
+    changelog_file_free (&modified_files[m]);
+  free (modified_files);
+  changelog_file_free (&mainstream_file);
+  changelog_file_free (&ancestor_file);
+  merge_context_free (&ctx);
+
+  return (num_conflicts > 0 ? 1 : 0);
+}
+
+void
+changelog_merge_result_free (struct changelog_merge_result *result)
+{
+  free (result->contents);
+  result->contents = NULL;
+  result->length = 0;
+  free (result->conflict_ends);
+  result->conflict_ends = NULL;
+  free (result->conflict_title);
+  result->conflict_title = NULL;
+  result->conflict_title_length = 0;
+}
+
+/* Return the class of the character C in a sketch: the letters, the digits
+   and the space have classes of their own, all other characters share the
+   last class.  */
+static int
+sketch_class (unsigned char c)
+{
+  if (c >= 'a' && c <= 'z')
+    return c - 'a';
+  if (c >= 'A' && c <= 'Z')
+    return 26 + (c - 'A');
+  if (c >= '0' && c <= '9')
+    return 52 + (c - '0');
+  if (c == ' ')
+    return 62;
+  return 63;
+}
+
+/* Compute the sketch of the entry STRING[0..LENGTH-1].  */
+static void
+sketch_compute (const char *string, size_t length,
+                struct changelog_sketch *sketch)
+{
+  struct entry entry;
+  uint32_t h;
+  size_t i;
+  int k;
+
+  entry.string = string;
+  entry.length = length;
+  sketch->length = length;
+  sketch->title_length = find_paragraph_end (&entry, 0);
+  /* FNV-1a.  */
+  h = 2166136261U;
+  for (i = 0; i < sketch->title_length; i++)
+    {
+      h ^= (unsigned char) string[i];
+      h *= 16777619U;
+    }
+  sketch->title_hash = h;
+  sketch->flags =
+    (memchr (string, '\0', length) != NULL ? CHANGELOG_SKETCH_HAS_NUL : 0);
+
+  memset (sketch->classes, 0, sizeof (sketch->classes));
+  for (i = 0; i < length; i++)
+    {
+      int c = sketch_class (string[i]);
+      if (sketch->classes[c] < UINT16_MAX)
+        sketch->classes[c]++;
+    }
+
+  for (k = 0; k < CHANGELOG_SKETCH_HASHES; k++)
+    sketch->minhash[k] = UINT32_MAX;
+  for (i = 0; i + 4 <= length; i++)
+    {
+      uint32_t gram = ((uint32_t) (unsigned char) string[i] << 24)
+                      | ((uint32_t) (unsigned char) string[i + 1] << 16)
+                      | ((uint32_t) (unsigned char) string[i + 2] << 8)
+                      | (uint32_t) (unsigned char) string[i + 3];
+      for (k = 0; k < CHANGELOG_SKETCH_HASHES; k++)
+        {
+          /* A different hash function for each K.  */
+          uint32_t x = (gram ^ ((uint32_t) (k + 1) * 0x9E3779B9U)) * 0x85EBCA6BU;
+          x ^= x >> 13;
+          x *= 0xC2B2AE35U;
+          x ^= x >> 16;
+          if (x < sketch->minhash[k])
+            sketch->minhash[k] = x;
+        }
+    }
+}
+
+int
+changelog_index_compute (const struct changelog_buffer *buffer,
+                         struct changelog_index *index)
+{
+  size_t *ends;
+  size_t num_ends;
+  uint64_t *index_ends;
+  struct changelog_sketch *sketches;
+  size_t entry_start;
+  size_t k;
+
+  find_entry_ends (buffer->contents, buffer->length, &ends, &num_ends);
+  if (num_ends > ENTRY_COUNT_MAX)
+    {
+      free (ends);
+      errno = EOVERFLOW;
+      return -1;
+    }
+
+  index_ends = XNMALLOC (num_ends, uint64_t);
+  sketches = XNMALLOC (num_ends, struct changelog_sketch);
+  entry_start = 0;
+  for (k = 0; k < num_ends; k++)
+    {
+      index_ends[k] = ends[k];
+      sketch_compute (buffer->contents + entry_start, ends[k] - entry_start,
+                      &sketches[k]);
+      entry_start = ends[k];
+    }
+  free (ends);
+
+  index->num_entries = num_ends;
+  index->ends = index_ends;
+  index->sketches = sketches;
+  return 0;
+}
+
+void
+changelog_index_free (struct changelog_index *index)
+{
+  free ((void *) index->ends);
+  index->ends = NULL;
+  free ((void *) index->sketches);
+  index->sketches = NULL;
+  index->num_entries = 0;
+}
@@ -0,0 +1,243 @@
+/* changelog-merge - merge engine for GNU style ChangeLog files.
+   Copyright (C) 2008-2010 Bruno Haible <bruno@clisp.org>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _CHANGELOG_MERGE_H
+#define _CHANGELOG_MERGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* The merge engine behind git-merge-changelog, usable from other programs.
+   It has no global state: any number of merges can run concurrently, in
+   different threads.  Memory allocation failures are fatal, through
+   xalloc_die().  */
+
+/* Number of character classes and of hash functions in a sketch.  */
+#define CHANGELOG_SKETCH_CLASSES 64
+#define CHANGELOG_SKETCH_HASHES 16
+
+/* Flags of a sketch.  */
+#define CHANGELOG_SKETCH_HAS_NUL 1
+
+/* A compact summary of a ChangeLog entry.  It lets the merge discard most
+   candidates of a fuzzy comparison without looking at their contents.  */
+struct changelog_sketch
+{
+  /* The length of the entry.  */
+  uint64_t length;
+  /* The length of its title (first paragraph, including the newline), and a
+     hash code of the title.  */
+  uint64_t title_length;
+  uint32_t title_hash;
+  uint32_t flags;
+  /* For each hash function, the minimum hash code of the 4-grams of the
+     entry (MinHash).  The fraction of equal values estimates how similar
+     two entries are.  */
+  uint32_t minhash[CHANGELOG_SKETCH_HASHES];
+  /* The number of characters in each class, saturated at 65535.  */
+  uint16_t classes[CHANGELOG_SKETCH_CLASSES];
+};
+
+/* The entries of a ChangeLog file, with their sketches.  It depends only on
+   the contents of the file, therefore it can be computed once and reused
+   for any number of merges.  */
+struct changelog_index
+{
+  size_t num_entries;
+  /* The offsets where the entries end.  The last one is the length of the
+     file.  */
+  const uint64_t *ends;
+  const struct changelog_sketch *sketches;
+};
+
+/* The contents of a ChangeLog file, in memory.  The contents may contain NUL
+   bytes.  */
+struct changelog_buffer
+{
+  const char *contents;
+  size_t length;
+  /* The index of the contents, or NULL.  Without an index, the merge splits
+     the file itself, and doesn't use sketches.  */
+  const struct changelog_index *index;
+};
+
+/* Parameters of a merge.  */
+struct changelog_merge_options
+{
+  /* Whether to split a merged entry at the top of a modified file between
+     paragraphs, when this makes the change simple.  Default: true.  */
+  bool split_merged_entry;
+  /* Time budget for the expensive stages, in milliseconds, or -1 for no
+     limit.  When it is used up, the merge falls back to exact matching and
+     coarser conflicts.  Default: -1.  */
+  long time_budget;
+  /* Whether to only determine whether the merge is clean: stop after the
+     edit that makes the first conflict, and don't produce the merged file.
+     Default: false.  */
+  bool probe;
+};
+
+/* Kinds of merges that need no work, because some of the files are
+   identical.  */
+enum changelog_merge_trivial
+{
+  /* The merge is not trivial.  */
+  CHANGELOG_MERGE_NOT_TRIVIAL,
+  /* The modified files are equal to the ancestor: the result is the mainstream
+     file.  */
+  CHANGELOG_MERGE_MODIFIED_UNCHANGED,
+  /* The mainstream file is equal to the ancestor, and there is a single
+     modified file: the result is the modified file.  */
+  CHANGELOG_MERGE_MAINSTREAM_UNCHANGED,
+  /* The modified files are equal to the mainstream file: the result is the
+     mainstream file.  */
+  CHANGELOG_MERGE_SAME_CHANGES
+};
+
+/* Statistics about a merge.  */
+struct changelog_merge_stats
+{
+  /* Number of entries of the ancestor file, of the mainstream file, and of
+     all modified files together.  */
+  size_t ancestor_entries;
+  size_t mainstream_entries;
+  size_t modified_entries;
+  /* Number of edits found between the ancestor and the modified files, in
+     total and by type.  In probe mode, only the modified files up to the
+     first conflict are counted.  */
+  size_t edits;
+  size_t additions;
+  size_t removals;
+  size_t changes;
+  /* Number of conflicts in the result.  In probe mode, the merge stops
+     after the edit that makes the first conflict, and one edit can make
+     several conflicts: then this is only at least 1 when the merge is not
+     clean.  */
+  size_t conflicts;
+  /* Number of fuzzy comparisons of entries that were performed.  */
+  size_t comparisons;
+  /* Number of fuzzy comparisons that the per-merge memo of entry pairs
+     avoided, and number of pairs that were evicted from the memo to make
+     room for others.  */
+  size_t similarity_avoided;
+  size_t memo_evictions;
+  /* Number of fuzzy comparisons that the sketches of the entries made
+     unnecessary.  */
+  size_t sketch_pruned;
+  /* Stages that produced a coarser result because the time budget was used
+     up.  */
+  bool degraded_mapping;
+  bool degraded_diff;
+  bool degraded_split;
+  /* Whether the merge was resolved without looking at the entries, and
+     why.  */
+  enum changelog_merge_trivial trivial;
+  /* Time spent in the stages of the merge, in microseconds: splitting the
+     files into entries, matching the entries of the ancestor and mainstream
+     files, computing the differences, applying them, and assembling the
+     merged file.  */
+  unsigned long split_time;
+  unsigned long mapping_time;
+  unsigned long diff_time;
+  unsigned long apply_time;
+  unsigned long output_time;
+};
+
+/* The result of a merge.  */
+struct changelog_merge_result
+{
+  /* The merged file, with the conflicts (if any) at the top.
+     Freshly allocated; release it with changelog_merge_result_free.
+     NULL in probe mode.  */
+  char *contents;
+  size_t length;
+  /* The offsets in CONTENTS where the conflicts end, one for each conflict.
+     Conflict i spans the bytes from conflict_ends[i - 1] (or 0 for the first
+     one) to conflict_ends[i].  The rest of CONTENTS, after all conflicts, is
+     the merged list of entries.  NULL in probe mode or if there are no
+     conflicts.  */
+  size_t *conflict_ends;
+  /* The title (first paragraph, without the final newline) of the first
+     entry in the first conflict, or NULL if there are no conflicts.
+     Freshly allocated.  */
+  char *conflict_title;
+  size_t conflict_title_length;
+  struct changelog_merge_stats stats;
+};
+
+/* Initialize *OPTIONS with the default values.  */
+extern void
+       changelog_merge_options_init (struct changelog_merge_options *options);
+
+/* Merge the modifications from ANCESTOR to each of MODIFIED[0..NUM_MODIFIED-1]
+   into MAINSTREAM, in this order.  MAINSTREAM is the file modified by other
+   committers; the entries added at the top of a modified file are put above
+   those of MAINSTREAM.
+   OPTIONS may be NULL, for the default options.
+   The caller keeps ownership of all buffers; none of them needs to outlive
+   the call.
+   When some of the files are identical, as described by
+   enum changelog_merge_trivial, the result is a copy of the winning file,
+   like git would resolve the merge by itself.
+   Return 0 if the merge is clean, 1 if the result contains conflicts, or -1
+   with errno set upon failure.  In the first two cases, *RESULT is filled
+   in.  */
+extern int
+       changelog_merge (const struct changelog_buffer *ancestor,
+                        const struct changelog_buffer *mainstream,
+                        const struct changelog_buffer *modified,
+                        size_t num_modified,
+                        const struct changelog_merge_options *options,
+                        struct changelog_merge_result *result);
+
+/* Determine whether a merge is trivial, by comparing the files.
+   Return the kind of trivial merge, and the file that is the result in
+   *WINNER.  */
+extern enum changelog_merge_trivial
+       changelog_merge_trivial (const struct changelog_buffer *ancestor,
+                                const struct changelog_buffer *mainstream,
+                                const struct changelog_buffer *modified,
+                                size_t num_modified,
+                                const struct changelog_buffer **winner);
+
+/* Free the memory held by *RESULT.  */
+extern void
+       changelog_merge_result_free (struct changelog_merge_result *result);
+
+/* Split the contents of BUFFER into entries and compute their sketches.
+   Its INDEX field is ignored.
+   Return 0 and the result in *INDEX, or -1 with errno set upon failure.  */
+extern int
+       changelog_index_compute (const struct changelog_buffer *buffer,
+                                struct changelog_index *index);
+
+/* Free the memory held by *INDEX, as returned by changelog_index_compute.  */
+extern void
+       changelog_index_free (struct changelog_index *index);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHANGELOG_MERGE_H */
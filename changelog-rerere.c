@@ -0,0 +1,501 @@
+/* changelog-rerere - reuse recorded resolutions of ChangeLog conflicts.
+   Copyright (C) 2008-2010 Bruno Haible <bruno@clisp.org>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+
+/* Specification.  */
+#include "changelog-rerere.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "read-file.h"
+#include "sha1.h"
+#include "xalloc.h"
+
+/* The file in the cache DIR for the key HEX, in the subdirectory SUBDIR if
+   not NULL, or else in the subdirectory named after the first two digits.
+   Freshly allocated.  */
+static char *
+cache_file_name (const char *dir, const char *subdir, const char *hex)
+{
+  size_t dir_len = strlen (dir);
+  char *name = XNMALLOC (dir_len + 1 + 8 + 1 + 40 + 1, char);
+
+  if (subdir != NULL)
+    sprintf (name, "%s/%s/%s", dir, subdir, hex);
+  else
+    sprintf (name, "%s/%.2s/%s", dir, hex, hex + 2);
+  return name;
+}
+
+/* Compute the key of a text: its SHA-1, in hexadecimal.  */
+static void
+compute_key (const char *text, size_t length, char hex[41])
+{
+  unsigned char digest[20];
+  size_t i;
+
+  sha1_buffer (text, length, digest);
+  for (i = 0; i < 20; i++)
+    sprintf (hex + 2 * i, "%02x", digest[i]);
+}
+
+/* A piece of a file.  */
+struct piece
+{
+  const char *text;
+  size_t length;
+  /* Whether this piece is a conflict that remains.  */
+  bool conflict;
+};
+
+/* Store the concatenation of PIECES[0..NUM_PIECES-1] in the file NAME,
+   which must be in a subdirectory of DIR.  The file appears atomically.
+   Return 0, or -1 with errno set upon failure.  */
+static int
+write_cache_file (const char *dir, const char *name,
+                  const struct piece *pieces, size_t num_pieces)
+{
+  size_t p;
+  char *subdir;
+  char *tmp_name;
+  FILE *fp;
+  int fd;
+
+  /* Create the subdirectory, if needed.  */
+  subdir = xstrdup (name);
+  *strrchr (subdir, '/') = '\0';
+  if (mkdir (subdir, 0777) < 0 && errno != EEXIST)
+    {
+      free (subdir);
+      return -1;
+    }
+  free (subdir);
+
+  tmp_name = XNMALLOC (strlen (dir) + 1 + 10 + 1, char);
+  sprintf (tmp_name, "%s/tmp-XXXXXX", dir);
+  fd = mkstemp (tmp_name);
+  if (fd < 0)
+    {
+      free (tmp_name);
+      return -1;
+    }
+  fp = fdopen (fd, "wb");
+  if (fp == NULL)
+    {
+      int saved_errno = errno;
+      close (fd);
+      unlink (tmp_name);
+      free (tmp_name);
+      errno = saved_errno;
+      return -1;
+    }
+  for (p = 0; p < num_pieces; p++)
+    fwrite (pieces[p].text, 1, pieces[p].length, fp);
+  if (ferror (fp) | (fclose (fp) != 0) || rename (tmp_name, name) < 0)
+    {
+      int saved_errno = errno;
+      unlink (tmp_name);
+      free (tmp_name);
+      errno = saved_errno;
+      return -1;
+    }
+  free (tmp_name);
+  return 0;
+}
+
+/* Return the offset of the end of the first ChangeLog entry in
+   CONTENTS[START..LENGTH-1].  */
+static size_t
+first_entry_end (const char *contents, size_t start, size_t length)
+{
+  size_t e;
+
+  for (e = start + 2; e < length; e++)
+    if (contents[e - 2] == '\n' && contents[e - 1] == '\n'
+        && !(contents[e] == '\n' || contents[e] == '\t' || contents[e] == ' '))
+      return e;
+  return length;
+}
+
+/* Return the title of the first entry of a conflict, given its text, as a
+   freshly allocated string, and its length in *LENGTHP.  */
+static char *
+conflict_text_title (const char *text, size_t length, size_t *lengthp)
+{
+  const char *end = text + length;
+  const char *title;
+  const char *title_end;
+  char *result;
+
+  /* Skip the "<<<<<<<" line, and the "=======" line if nothing precedes
+     it.  */
+  title = memchr (text, '\n', length);
+  title = (title != NULL ? title + 1 : end);
+  if (end - title >= 8 && memcmp (title, "=======\n", 8) == 0)
+    title += 8;
+  /* The title ends at the first blank line.  */
+  for (title_end = title; title_end < end; )
+    {
+      const char *nl = memchr (title_end, '\n', end - title_end);
+      if (nl == NULL || nl + 1 == end || nl[1] == '\n')
+        {
+          title_end = (nl != NULL ? nl : end);
+          break;
+        }
+      title_end = nl + 1;
+    }
+
+  *lengthp = title_end - title;
+  result = XNMALLOC (*lengthp + 1, char);
+  memcpy (result, title, *lengthp);
+  result[*lengthp] = '\0';
+  return result;
+}
+
+/* Look up the resolution for the key HEX in the cache DIR.
+   Return it, freshly allocated, or NULL if there is none.  */
+static char *
+lookup_resolution (const char *dir, const char *hex, size_t *lengthp)
+{
+  char *name = cache_file_name (dir, NULL, hex);
+  char *resolution = read_file (name, lengthp);
+
+  if (resolution == NULL && errno != ENOENT)
+    error (0, errno, "could not read file '%s'", name);
+  free (name);
+  return resolution;
+}
+
+size_t
+changelog_rerere_apply (const char *dir, struct changelog_merge_result *result)
+{
+  size_t num_conflicts = result->stats.conflicts;
+  char **resolutions;
+  size_t *resolution_lengths;
+  struct piece *pieces;
+  size_t num_pieces;
+  size_t first_unresolved;
+  size_t last_unresolved;
+  size_t num_unresolved;
+  char *combined;
+  size_t combined_length;
+  char unresolved_key[41];
+  size_t i;
+
+  if (num_conflicts == 0 || result->conflict_ends == NULL)
+    return 0;
+
+  /* Look up the conflicts one by one.  */
+  resolutions = XNMALLOC (num_conflicts, char *);
+  resolution_lengths = XNMALLOC (num_conflicts, size_t);
+  num_unresolved = 0;
+  first_unresolved = last_unresolved = 0;
+  for (i = 0; i < num_conflicts; i++)
+    {
+      size_t start = (i > 0 ? result->conflict_ends[i - 1] : 0);
+      size_t end = result->conflict_ends[i];
+      char hex[41];
+
+      compute_key (result->contents + start, end - start, hex);
+      resolutions[i] = lookup_resolution (dir, hex, &resolution_lengths[i]);
+      if (resolutions[i] == NULL)
+        {
+          if (num_unresolved == 0)
+            first_unresolved = i;
+          last_unresolved = i;
+          num_unresolved++;
+          memcpy (unresolved_key, hex, sizeof (unresolved_key));
+        }
+    }
+
+  /* Look up the remaining conflicts as a whole.  */
+  combined = NULL;
+  combined_length = 0;
+  if (num_unresolved > 1)
+    {
+      struct sha1_ctx sha1;
+      unsigned char digest[20];
+
+      sha1_init_ctx (&sha1);
+      for (i = first_unresolved; i <= last_unresolved; i++)
+        if (resolutions[i] == NULL)
+          {
+            size_t start = (i > 0 ? result->conflict_ends[i - 1] : 0);
+            sha1_process_bytes (result->contents + start,
+                                result->conflict_ends[i] - start, &sha1);
+          }
+      sha1_finish_ctx (&sha1, digest);
+      for (i = 0; i < 20; i++)
+        sprintf (unresolved_key + 2 * i, "%02x", digest[i]);
+      combined = lookup_resolution (dir, unresolved_key, &combined_length);
+    }
+
+  /* Assemble the pieces of the new merged file.  */
+  pieces = XNMALLOC (num_conflicts + 1, struct piece);
+  num_pieces = 0;
+  for (i = 0; i < num_conflicts; i++)
+    {
+      size_t start = (i > 0 ? result->conflict_ends[i - 1] : 0);
+
+      if (combined != NULL && i >= first_unresolved && i <= last_unresolved)
+        {
+          /* The combined resolution replaces everything from the first to
+             the last remaining conflict.  */
+          if (i == first_unresolved)
+            {
+              pieces[num_pieces].text = combined;
+              pieces[num_pieces].length = combined_length;
+              pieces[num_pieces].conflict = false;
+              num_pieces++;
+            }
+        }
+      else if (resolutions[i] != NULL)
+        {
+          pieces[num_pieces].text = resolutions[i];
+          pieces[num_pieces].length = resolution_lengths[i];
+          pieces[num_pieces].conflict = false;
+          num_pieces++;
+        }
+      else
+        {
+          pieces[num_pieces].text = result->contents + start;
+          pieces[num_pieces].length = result->conflict_ends[i] - start;
+          pieces[num_pieces].conflict = true;
+          num_pieces++;
+        }
+    }
+  pieces[num_pieces].text = result->contents + result->conflict_ends[i - 1];
+  pieces[num_pieces].length = result->length - result->conflict_ends[i - 1];
+  pieces[num_pieces].conflict = false;
+  num_pieces++;
+
+  {
+    size_t num_resolved = (combined != NULL ? num_conflicts
+                           : num_conflicts - num_unresolved);
+    size_t num_remaining = num_conflicts - num_resolved;
+
+    if (num_resolved > 0)
+      {
+        char *contents;
+        size_t length;
+        size_t first_conflict_start;
+        size_t c;
+        size_t p;
+
+        for (length = 0, p = 0; p < num_pieces; p++)
+          length += pieces[p].length;
+        contents = XNMALLOC (length, char);
+        first_conflict_start = 0;
+        for (length = 0, c = 0, p = 0; p < num_pieces; p++)
+          {
+            if (pieces[p].conflict && c == 0)
+              first_conflict_start = length;
+            memcpy (contents + length, pieces[p].text, pieces[p].length);
+            length += pieces[p].length;
+            if (pieces[p].conflict)
+              result->conflict_ends[c++] = length;
+          }
+
+        free (result->contents);
+        result->contents = contents;
+        result->length = length;
+        result->stats.conflicts = num_remaining;
+        free (result->conflict_title);
+        result->conflict_title = NULL;
+        result->conflict_title_length = 0;
+        if (num_remaining > 0)
+          result->conflict_title =
+            conflict_text_title (contents + first_conflict_start,
+                                 result->conflict_ends[0]
+                                 - first_conflict_start,
+                                 &result->conflict_title_length);
+        else
+          {
+            free (result->conflict_ends);
+            result->conflict_ends = NULL;
+          }
+      }
+
+    if (num_remaining > 0)
+      {
+        /* Remember the remaining conflicts, together with the text that
+           precedes them and the text that follows them up to the end of the
+           first entry after the conflicts.  */
+        size_t prefix_end;
+        size_t anchor_start = result->conflict_ends[num_remaining - 1];
+        size_t anchor_end =
+          first_entry_end (result->contents,
+                           result->length - pieces[num_pieces - 1].length,
+                           result->length);
+        char header[64];
+        struct piece record[3];
+        char *name;
+        size_t p;
+
+        for (prefix_end = 0, p = 0; !pieces[p].conflict; p++)
+          prefix_end += pieces[p].length;
+
+        sprintf (header, "%lu %lu\n",
+                 (unsigned long) prefix_end,
+                 (unsigned long) (anchor_end - anchor_start));
+        record[0].text = header;
+        record[0].length = strlen (header);
+        record[1].text = result->contents;
+        record[1].length = prefix_end;
+        record[2].text = result->contents + anchor_start;
+        record[2].length = anchor_end - anchor_start;
+        name = cache_file_name (dir, "pending", unresolved_key);
+        if (write_cache_file (dir, name, record, 3) < 0)
+          error (0, errno, "could not write file '%s'", name);
+        free (name);
+      }
+
+    for (i = 0; i < num_conflicts; i++)
+      free (resolutions[i]);
+    free (resolutions);
+    free (resolution_lengths);
+    free (combined);
+    free (pieces);
+    return num_resolved;
+  }
+}
+
+/* Return true if CONTENTS contains a conflict marker line.  */
+static bool
+has_conflict_markers (const char *contents, size_t length)
+{
+  static const char *markers[] = { "<<<<<<<\n", "=======\n", ">>>>>>>\n" };
+  const char *line;
+  const char *end = contents + length;
+
+  for (line = contents; line < end; )
+    {
+      const char *nl = memchr (line, '\n', end - line);
+      size_t m;
+
+      if (nl == NULL)
+        break;
+      for (m = 0; m < 3; m++)
+        if (nl + 1 - line == 8 && memcmp (line, markers[m], 8) == 0)
+          return true;
+      line = nl + 1;
+    }
+  return false;
+}
+
+int
+changelog_rerere_record (const char *dir, const char *contents, size_t length)
+{
+  char *pending_dir;
+  DIR *dirp;
+  struct dirent *dp;
+  int count;
+
+  pending_dir = XNMALLOC (strlen (dir) + 8 + 1, char);
+  sprintf (pending_dir, "%s/pending", dir);
+  dirp = opendir (pending_dir);
+  if (dirp == NULL)
+    {
+      free (pending_dir);
+      return (errno == ENOENT ? 0 : -1);
+    }
+
+  count = 0;
+  while ((dp = readdir (dirp)) != NULL)
+    {
+      const char *hex = dp->d_name;
+      char *pending_name;
+      char *record;
+      size_t record_length;
+      unsigned long prefix_length;
+      unsigned long anchor_length;
+      const char *prefix;
+      const char *anchor;
+      const char *resolution_end;
+      int header_length;
+
+      if (strlen (hex) != 40 || strspn (hex, "0123456789abcdef") != 40)
+        continue;
+
+      pending_name = cache_file_name (dir, "pending", hex);
+      record = read_file (pending_name, &record_length);
+      if (record == NULL
+          || sscanf (record, "%lu %lu\n%n",
+                     &prefix_length, &anchor_length, &header_length) < 2
+          || record_length != header_length + prefix_length + anchor_length)
+        {
+          /* Removed by a concurrent process, or not a pending record.  */
+          free (record);
+          free (pending_name);
+          continue;
+        }
+      prefix = record + header_length;
+      anchor = prefix + prefix_length;
+
+      /* The resolution is between the text that preceded the conflicts and
+         the text that followed them.  */
+      if (prefix_length <= length
+          && memcmp (contents, prefix, prefix_length) == 0)
+        {
+          if (anchor_length == 0)
+            resolution_end = contents + length;
+          else
+            resolution_end = memmem (contents + prefix_length,
+                                     length - prefix_length,
+                                     anchor, anchor_length);
+          if (resolution_end != NULL
+              && !has_conflict_markers (contents + prefix_length,
+                                        resolution_end
+                                        - (contents + prefix_length)))
+            {
+              struct piece resolution;
+              char *name = cache_file_name (dir, NULL, hex);
+
+              resolution.text = contents + prefix_length;
+              resolution.length = resolution_end - resolution.text;
+              if (write_cache_file (dir, name, &resolution, 1) < 0)
+                {
+                  int saved_errno = errno;
+                  free (name);
+                  free (record);
+                  free (pending_name);
+                  closedir (dirp);
+                  free (pending_dir);
+                  errno = saved_errno;
+                  return -1;
+                }
+              free (name);
+              unlink (pending_name);
+              count++;
+            }
+        }
+      free (record);
+      free (pending_name);
+    }
+
+  closedir (dirp);
+  free (pending_dir);
+  return count;
+}
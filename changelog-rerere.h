@@ -0,0 +1,70 @@
+/* changelog-rerere - reuse recorded resolutions of ChangeLog conflicts.
+   Copyright (C) 2008-2010 Bruno Haible <bruno@clisp.org>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _CHANGELOG_RERERE_H
+#define _CHANGELOG_RERERE_H
+
+#include <stddef.h>
+
+#include "changelog-merge.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* A cache of conflict resolutions, in the style of "git rerere".
+
+   The cache is a directory.  A conflict is identified by the SHA-1 of its
+   text, as it appears in the merged file (including the markers).  The
+   resolution of the conflict with SHA-1 xxyyyy... is stored in the file
+   xx/yyyy... of the directory, so that looking it up costs a single open().
+
+   When a merge leaves conflicts that have no recorded resolution, they are
+   remembered in the file pending/<sha1>, together with the text around them.
+   After the user has resolved them, changelog_rerere_record finds that text
+   in the resolved ChangeLog file, and records what is in between as the
+   resolution.  If several conflicts remain, they are resolved as a whole:
+   the key is the SHA-1 of their concatenated texts.
+
+   All files are written to a temporary file first and then renamed into
+   place; therefore any number of processes can use the same cache
+   concurrently.  */
+
+/* Replace the conflicts in *RESULT that have a recorded resolution in the
+   cache DIR, and remember the remaining ones as pending.
+   Return the number of resolved conflicts, and update *RESULT and its
+   statistics.  Problems with the cache directory are reported as warnings;
+   they don't prevent the merge.  */
+extern size_t
+       changelog_rerere_apply (const char *dir,
+                               struct changelog_merge_result *result);
+
+/* Record the resolutions of the pending conflicts in the cache DIR that have
+   been resolved in the ChangeLog file CONTENTS.
+   Return the number of recorded resolutions, or -1 with errno set if the
+   cache could not be written.  */
+extern int
+       changelog_rerere_record (const char *dir,
+                                const char *contents, size_t length);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHANGELOG_RERERE_H */
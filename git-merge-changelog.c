@@ -62,6 +62,28 @@
 
        (See "man 5 gitattributes" for more info.)
 
+     - To have conflicts that were resolved once resolved automatically the
+       next time they occur, like "git rerere" does, pass a cache directory:
+
+                  driver = /usr/local/bin/git-merge-changelog \
+                             --rerere=.git/changelog-rerere %O %A %B
+
+       and, after resolving conflicts in a ChangeLog file and before
+       committing, record the resolutions:
+
+          $ git-merge-changelog --rerere=.git/changelog-rerere --record ChangeLog
+
+       (A post-commit hook is a good place for this.)
+
+     - To have the entries of the ChangeLog files, and summaries of them
+       that speed up the fuzzy matching, computed only once for each
+       version of the file, pass an index cache directory:
+
+                  driver = /usr/local/bin/git-merge-changelog \
+                             --index-cache=.git/changelog-index %O %A %B
+
+       The cache can be deleted at any time.
+
    Additionally, for bzr users:
      - Install the 'extmerge' bzr plug-in listed at
          <http://doc.bazaar.canonical.com/plugins/en/index.html>
@@ -86,6 +108,23 @@
 
        See <http://www.selenic.com/mercurial/hgrc.5.html> section merge-tools
        for reference.
+
+   Additionally, for programs that want to merge ChangeLog files in-process:
+     - The merge engine is in changelog-merge.c, with the interface declared
+       in changelog-merge.h.  The conflict resolution cache is in
+       changelog-rerere.c, and the index cache in changelog-index-cache.c,
+       with the interfaces declared in changelog-rerere.h and
+       changelog-index-cache.h.  They use the same gnulib modules as this
+       program.  In the testdir created above, build them as a library with
+
+          $ gcc -c -fPIC -I. -Igllib changelog-merge.c changelog-rerere.c \
+                changelog-index-cache.c
+          $ ar rc libchangelog-merge.a changelog-merge.o changelog-rerere.o \
+                changelog-index-cache.o
+          $ gcc -shared -o libchangelog-merge.so changelog-merge.o \
+                changelog-rerere.o changelog-index-cache.o gllib/libgnu.a
+
+       and link the static library together with gllib/libgnu.a.
  */
 
 /* Use as an alternative to 'diff3':
@@ -115,853 +154,539 @@
    It should write its merged output into file %A. It can also echo some
    remarks to stdout.  It should exit with return code 0 if the merge could
    be resolved cleanly, or with non-zero return code if there were conflicts.
- */
 
-/* How it works:
-   The structure of a ChangeLog file: It consists of ChangeLog entries. A
-   ChangeLog entry starts at a line following a blank line and that starts with
-   a non-whitespace character, or at the beginning of a file.
-   The merge driver works as follows: It reads the three files into memory and
-   dissects them into ChangeLog entries. It then finds the differences between
-   %O and %B. They are classified as:
-     - removals (some consecutive entries removed),
-     - changes (some consecutive entries removed, some consecutive entries
-       added),
-     - additions (some consecutive entries added).
-   The driver then attempts to apply the changes to %A.
-   To this effect, it first computes a correspondence between the entries in %O
-   and the entries in %A, using fuzzy string matching to still identify changed
-   entries.
-     - Removals are applied one by one. If the entry is present in %A, at any
-       position, it is removed. If not, the removal is marked as a conflict.
-     - Additions at the top of %B are applied at the top of %A.
-     - Additions between entry x and entry y (y may be the file end) in %B are
-       applied between entry x and entry y in %A (if they still exist and are
-       still consecutive in %A), otherwise the additions are marked as a
-       conflict.
-     - Changes are categorized into "simple changes":
-         entry1 ... entryn
-       are mapped to
-         added_entry ... added_entry modified_entry1 ... modified_entryn,
-       where the correspondence between entry_i and modified_entry_i is still
-       clear; and "big changes": these are all the rest. Simple changes at the
-       top of %B are applied by putting the added entries at the top of %A. The
-       changes in simple changes are applied one by one; possibly leading to
-       single-entry conflicts. Big changes are applied en bloc, possibly
-       leading to conflicts spanning multiple entries.
-     - Conflicts are output at the top of the file and cause an exit status of
-       1.
+   For octopus merges, more than one %B can be passed:
+     $ git-merge-changelog %O %A %B1 ... %Bn
+   Then %A is always considered as the file modified by other committers, and
+   the modifications of %B1, ..., %Bn relative to %O are applied to it in a
+   single pass, in this order.
  */
 
 #include <config.h>
 
 #include <getopt.h>
 #include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
-
+#ifdef __linux__
+# include <sys/ioctl.h>
+# include <linux/fs.h>
+#endif
+
+#include "changelog-merge.h"
+#include "changelog-index-cache.h"
+#include "changelog-rerere.h"
+#include "glthread/thread.h"
 #include "progname.h"
 #include "error.h"
 #include "read-file.h"
-#include "gl_xlist.h"
-#include "gl_array_list.h"
-#include "gl_linkedhash_list.h"
-#include "gl_rbtreehash_list.h"
-#include "gl_linked_list.h"
 #include "xalloc.h"
-#include "xmalloca.h"
-#include "fstrcmp.h"
-#include "minmax.h"
 #include "c-strstr.h"
 #include "fwriteerror.h"
+#include "sha1.h"
 
-#define ASSERT(expr) \
-  do                                                                         \
-    {                                                                        \
-      if (!(expr))                                                           \
-        abort ();                                                            \
-    }                                                                        \
-  while (0)
-
-#define FSTRCMP_THRESHOLD 0.6
-#define FSTRCMP_STRICTER_THRESHOLD 0.8
-
-/* Representation of a ChangeLog entry.
-   The string may contain NUL bytes; therefore it is represented as a plain
-   opaque memory region.  */
-struct entry
+/* A ChangeLog file to be read into memory.  */
+struct read_job
 {
-  char *string;
+  const char *filename;
+  /* The index cache directory, or NULL.  */
+  const char *index_cache;
+  /* The contents, or NULL if the file could not be read.  */
+  char *contents;
   size_t length;
-  /* Cache for the hash code.  */
-  bool hashcode_cached;
-  size_t hashcode;
+  /* The index of the contents, if HAVE_INDEX.  */
+  bool have_index;
+  struct changelog_cached_index index;
 };
 
-/* Create an entry.
-   The memory region passed by the caller must of indefinite extent.  It is
-   *not* copied here.  */
-static struct entry *
-entry_create (char *string, size_t length)
-{
-  struct entry *result = XMALLOC (struct entry);
-  result->string = string;
-  result->length = length;
-  result->hashcode_cached = false;
-  return result;
-}
-
-/* Compare two entries for equality.  */
-static bool
-entry_equals (const void *elt1, const void *elt2)
+/* Read a ChangeLog file into memory, and get its index.  */
+static void *
+read_changelog_file (void *arg)
 {
-  const struct entry *entry1 = (const struct entry *) elt1;
-  const struct entry *entry2 = (const struct entry *) elt2;
-  return entry1->length == entry2->length
-         && memcmp (entry1->string, entry2->string, entry1->length) == 0;
-}
+  struct read_job *job = (struct read_job *) arg;
 
-/* Return a hash code of the contents of a ChangeLog entry.  */
-static size_t
-entry_hashcode (const void *elt)
-{
-  struct entry *entry = (struct entry *) elt;
-  if (!entry->hashcode_cached)
+  /* Read the file in text mode, otherwise it's hard to recognize empty
+     lines.  */
+  job->contents = read_file (job->filename, &job->length);
+  job->have_index = false;
+  if (job->contents != NULL && job->index_cache != NULL)
     {
-      /* See http://www.haible.de/bruno/hashfunc.html.  */
-      const char *s;
-      size_t n;
-      size_t h = 0;
+      struct changelog_buffer buffer;
 
-      for (s = entry->string, n = entry->length; n > 0; s++, n--)
-        h = (unsigned char) *s + ((h << 9) | (h >> (sizeof (size_t) * CHAR_BIT - 9)));
-
-      entry->hashcode = h;
-      entry->hashcode_cached = true;
+      buffer.contents = job->contents;
+      buffer.length = job->length;
+      buffer.index = NULL;
+      job->have_index =
+        changelog_index_cache_get (job->index_cache, &buffer, &job->index);
     }
-  return entry->hashcode;
+  return NULL;
 }
 
-/* Perform a fuzzy comparison of two ChangeLog entries.
-   Return a similarity measure of the two entries, a value between 0 and 1.
-   0 stands for very distinct, 1 for identical.
-   If the result is < LOWER_BOUND, an arbitrary other value < LOWER_BOUND can
-   be returned.  */
-static double
-entry_fstrcmp (const struct entry *entry1, const struct entry *entry2,
-               double lower_bound)
-{
-  /* fstrcmp works only on NUL terminated strings.  */
-  char *memory;
-  double similarity;
-
-  if (memchr (entry1->string, '\0', entry1->length) != NULL)
-    return 0.0;
-  if (memchr (entry2->string, '\0', entry2->length) != NULL)
-    return 0.0;
-  memory = (char *) xmalloca (entry1->length + 1 + entry2->length + 1);
-  {
-    char *p = memory;
-    memcpy (p, entry1->string, entry1->length);
-    p += entry1->length;
-    *p++ = '\0';
-    memcpy (p, entry2->string, entry2->length);
-    p += entry2->length;
-    *p++ = '\0';
-  }
-  similarity =
-    fstrcmp_bounded (memory, memory + entry1->length + 1, lower_bound);
-  freea (memory);
-  return similarity;
-}
-
-/* This structure represents an entire ChangeLog file, after it was read
-   into memory.  */
-struct changelog_file
-{
-  /* The entries, as a list.  */
-  gl_list_t /* <struct entry *> */ entries_list;
-  /* The entries, as a list in opposite direction.  */
-  gl_list_t /* <struct entry *> */ entries_reversed;
-  /* The entries, as an array.  */
-  size_t num_entries;
-  struct entry **entries;
-};
-
-/* Read a ChangeLog file into memory.
-   Return the contents in *RESULT.  */
+/* Read the ChangeLog files JOBS[0..NUM_JOBS-1] into memory, concurrently
+   when possible.  Exit upon failure.  */
 static void
-read_changelog_file (const char *filename, struct changelog_file *result)
+read_changelog_files (struct read_job *jobs, size_t num_jobs)
 {
-  /* Read the file in text mode, otherwise it's hard to recognize empty
-     lines.  */
-  size_t length;
-  char *contents = read_file (filename, &length);
-  if (contents == NULL)
-    {
-      fprintf (stderr, "could not read file '%s'\n", filename);
-      exit (EXIT_FAILURE);
-    }
-
-  result->entries_list =
-    gl_list_create_empty (GL_LINKEDHASH_LIST, entry_equals, entry_hashcode,
-                          NULL, true);
-  result->entries_reversed =
-    gl_list_create_empty (GL_RBTREEHASH_LIST, entry_equals, entry_hashcode,
-                          NULL, true);
-  /* A ChangeLog file consists of ChangeLog entries.  A ChangeLog entry starts
-     at a line following a blank line and that starts with a non-whitespace
-     character, or at the beginning of a file.
-     Split the file contents into entries.  */
-  {
-    char *contents_end = contents + length;
-    char *start = contents;
-    while (start < contents_end)
+  size_t j;
+
+#if USE_POSIX_THREADS || USE_SOLARIS_THREADS || USE_PTH_THREADS || USE_WIN32_THREADS
+  gl_thread_t *threads = XNMALLOC (num_jobs, gl_thread_t);
+  for (j = 1; j < num_jobs; j++)
+    threads[j] = gl_thread_create (read_changelog_file, &jobs[j]);
+  read_changelog_file (&jobs[0]);
+  for (j = 1; j < num_jobs; j++)
+    gl_thread_join (threads[j], NULL);
+  free (threads);
+#else
+  for (j = 0; j < num_jobs; j++)
+    read_changelog_file (&jobs[j]);
+#endif
+
+  for (j = 0; j < num_jobs; j++)
+    if (jobs[j].contents == NULL)
       {
-        /* Search the end of the current entry.  */
-        char *ptr = start;
-        struct entry *curr;
-
-        while (ptr < contents_end)
-          {
-            ptr = memchr (ptr, '\n', contents_end - ptr);
-            if (ptr == NULL)
-              {
-                ptr = contents_end;
-                break;
-              }
-            ptr++;
-            if (contents_end - ptr >= 2
-                && ptr[0] == '\n'
-                && !(ptr[1] == '\n' || ptr[1] == '\t' || ptr[1] == ' '))
-              {
-                ptr++;
-                break;
-              }
-          }
-
-        curr = entry_create (start, ptr - start);
-        gl_list_add_last (result->entries_list, curr);
-        gl_list_add_first (result->entries_reversed, curr);
-
-        start = ptr;
+        fprintf (stderr, "could not read file '%s'\n", jobs[j].filename);
+        exit (EXIT_FAILURE);
       }
-  }
-
-  result->num_entries = gl_list_size (result->entries_list);
-  result->entries = XNMALLOC (result->num_entries, struct entry *);
-  {
-    size_t index = 0;
-    gl_list_iterator_t iter = gl_list_iterator (result->entries_list);
-    const void *elt;
-    gl_list_node_t node;
-    while (gl_list_iterator_next (&iter, &elt, &node))
-      result->entries[index++] = (struct entry *) elt;
-    gl_list_iterator_free (&iter);
-    ASSERT (index == result->num_entries);
-  }
 }
 
-/* A mapping (correspondence) between entries of FILE1 and of FILE2.  */
-struct entries_mapping
-{
-  struct changelog_file *file1;
-  struct changelog_file *file2;
-  /* Mapping from indices in FILE1 to indices in FILE2.
-     A value -1 means that the entry from FILE1 is not found in FILE2.
-     A value -2 means that it has not yet been computed.  */
-  ssize_t *index_mapping;
-  /* Mapping from indices in FILE2 to indices in FILE1.
-     A value -1 means that the entry from FILE2 is not found in FILE1.
-     A value -2 means that it has not yet been computed.  */
-  ssize_t *index_mapping_reverse;
-};
-
-/* Look up (or lazily compute) the mapping of an entry in FILE1.
-   i is the index in FILE1.
-   Return the index in FILE2, or -1 when the entry is not found in FILE2.  */
-static ssize_t
-entries_mapping_get (struct entries_mapping *mapping, ssize_t i)
+/* Compare two files for equality, without reading them into memory.
+   Return false also if one of them cannot be read.  */
+static bool
+files_equal (const char *filename1, const char *filename2)
 {
-  if (mapping->index_mapping[i] < -1)
+  FILE *fp1;
+  FILE *fp2;
+  struct stat statbuf1;
+  struct stat statbuf2;
+  bool equal;
+
+  fp1 = fopen (filename1, "rb");
+  if (fp1 == NULL)
+    return false;
+  fp2 = fopen (filename2, "rb");
+  if (fp2 == NULL)
     {
-      struct changelog_file *file1 = mapping->file1;
-      struct changelog_file *file2 = mapping->file2;
-      size_t n1 = file1->num_entries;
-      size_t n2 = file2->num_entries;
-      struct entry *entry_i = file1->entries[i];
-      ssize_t j;
-
-      /* Search whether it approximately occurs in file2.  */
-      ssize_t best_j = -1;
-      double best_j_similarity = 0.0;
-      for (j = n2 - 1; j >= 0; j--)
-        if (mapping->index_mapping_reverse[j] < 0)
-          {
-            double similarity =
-              entry_fstrcmp (entry_i, file2->entries[j], best_j_similarity);
-            if (similarity > best_j_similarity)
-              {
-                best_j = j;
-                best_j_similarity = similarity;
-              }
-          }
-      if (best_j_similarity >= FSTRCMP_THRESHOLD)
-        {
-          /* Found a similar entry in file2.  */
-          struct entry *entry_j = file2->entries[best_j];
-          /* Search whether it approximately occurs in file1 at index i.  */
-          ssize_t best_i = -1;
-          double best_i_similarity = 0.0;
-          ssize_t ii;
-          for (ii = n1 - 1; ii >= 0; ii--)
-            if (mapping->index_mapping[ii] < 0)
-              {
-                double similarity =
-                  entry_fstrcmp (file1->entries[ii], entry_j,
-                                 best_i_similarity);
-                if (similarity > best_i_similarity)
-                  {
-                    best_i = ii;
-                    best_i_similarity = similarity;
-                  }
-              }
-          if (best_i_similarity >= FSTRCMP_THRESHOLD && best_i == i)
-            {
-              mapping->index_mapping[i] = best_j;
-              mapping->index_mapping_reverse[best_j] = i;
-            }
-        }
-      if (mapping->index_mapping[i] < -1)
-        /* It does not approximately occur in FILE2.
-           Remember it, for next time.  */
-        mapping->index_mapping[i] = -1;
+      fclose (fp1);
+      return false;
     }
-  return mapping->index_mapping[i];
-}
 
-/* Look up (or lazily compute) the mapping of an entry in FILE2.
-   j is the index in FILE2.
-   Return the index in FILE1, or -1 when the entry is not found in FILE1.  */
-static ssize_t
-entries_mapping_reverse_get (struct entries_mapping *mapping, ssize_t j)
-{
-  if (mapping->index_mapping_reverse[j] < -1)
+  if (fstat (fileno (fp1), &statbuf1) < 0
+      || fstat (fileno (fp2), &statbuf2) < 0)
+    equal = false;
+  else if (statbuf1.st_dev == statbuf2.st_dev
+           && statbuf1.st_ino == statbuf2.st_ino)
+    equal = true;
+  else if (S_ISREG (statbuf1.st_mode) && S_ISREG (statbuf2.st_mode)
+           && statbuf1.st_size != statbuf2.st_size)
+    equal = false;
+  else
     {
-      struct changelog_file *file1 = mapping->file1;
-      struct changelog_file *file2 = mapping->file2;
-      size_t n1 = file1->num_entries;
-      size_t n2 = file2->num_entries;
-      struct entry *entry_j = file2->entries[j];
-      ssize_t i;
-
-      /* Search whether it approximately occurs in file1.  */
-      ssize_t best_i = -1;
-      double best_i_similarity = 0.0;
-      for (i = n1 - 1; i >= 0; i--)
-        if (mapping->index_mapping[i] < 0)
-          {
-            double similarity =
-              entry_fstrcmp (file1->entries[i], entry_j, best_i_similarity);
-            if (similarity > best_i_similarity)
-              {
-                best_i = i;
-                best_i_similarity = similarity;
-              }
-          }
-      if (best_i_similarity >= FSTRCMP_THRESHOLD)
+      char buf1[16384];
+      char buf2[16384];
+
+      for (;;)
         {
-          /* Found a similar entry in file1.  */
-          struct entry *entry_i = file1->entries[best_i];
-          /* Search whether it approximately occurs in file2 at index j.  */
-          ssize_t best_j = -1;
-          double best_j_similarity = 0.0;
-          ssize_t jj;
-          for (jj = n2 - 1; jj >= 0; jj--)
-            if (mapping->index_mapping_reverse[jj] < 0)
-              {
-                double similarity =
-                  entry_fstrcmp (entry_i, file2->entries[jj],
-                                 best_j_similarity);
-                if (similarity > best_j_similarity)
-                  {
-                    best_j = jj;
-                    best_j_similarity = similarity;
-                  }
-              }
-          if (best_j_similarity >= FSTRCMP_THRESHOLD && best_j == j)
+          size_t n1 = fread (buf1, 1, sizeof (buf1), fp1);
+          size_t n2 = fread (buf2, 1, sizeof (buf2), fp2);
+          if (n1 != n2 || memcmp (buf1, buf2, n1) != 0)
             {
-              mapping->index_mapping_reverse[j] = best_i;
-              mapping->index_mapping[best_i] = j;
+              equal = false;
+              break;
+            }
+          if (n1 < sizeof (buf1))
+            {
+              equal = !(ferror (fp1) || ferror (fp2));
+              break;
             }
         }
-      if (mapping->index_mapping_reverse[j] < -1)
-        /* It does not approximately occur in FILE1.
-           Remember it, for next time.  */
-        mapping->index_mapping_reverse[j] = -1;
     }
-  return mapping->index_mapping_reverse[j];
+
+  fclose (fp1);
+  fclose (fp2);
+  return equal;
 }
 
-/* Compute a mapping (correspondence) between entries of FILE1 and of FILE2.
-   The correspondence also takes into account small modifications; i.e. the
-   indicated relation is not equality of entries but best-match similarity
-   of entries.
-   If FULL is true, the maximum of matching is done up-front.  If it is false,
-   it is done in a lazy way through the functions entries_mapping_get and
-   entries_mapping_reverse_get.
-   Return the result in *RESULT.  */
-static void
-compute_mapping (struct changelog_file *file1, struct changelog_file *file2,
-                 bool full,
-                 struct entries_mapping *result)
+/* Return the size of the file FILENAME, or 0 if it cannot be determined.  */
+static size_t
+file_size (const char *filename)
 {
-  /* Mapping from indices in file1 to indices in file2.  */
-  ssize_t *index_mapping;
-  /* Mapping from indices in file2 to indices in file1.  */
-  ssize_t *index_mapping_reverse;
-  size_t n1 = file1->num_entries;
-  size_t n2 = file2->num_entries;
-  ssize_t i, j;
-
-  index_mapping = XNMALLOC (n1, ssize_t);
-  for (i = 0; i < n1; i++)
-    index_mapping[i] = -2;
-
-  index_mapping_reverse = XNMALLOC (n2, ssize_t);
-  for (j = 0; j < n2; j++)
-    index_mapping_reverse[j] = -2;
-
-  for (i = n1 - 1; i >= 0; i--)
-    /* Take an entry from file1.  */
-    if (index_mapping[i] < -1)
-      {
-        struct entry *entry = file1->entries[i];
-        /* Search whether it occurs in file2.  */
-        j = gl_list_indexof (file2->entries_reversed, entry);
-        if (j >= 0)
-          {
-            j = n2 - 1 - j;
-            /* Found an exact correspondence.  */
-            /* If index_mapping_reverse[j] >= 0, we have already seen other
-               copies of this entry, and there were more occurrences of it in
-               file1 than in file2.  In this case, do nothing.  */
-            if (index_mapping_reverse[j] < 0)
-              {
-                index_mapping[i] = j;
-                index_mapping_reverse[j] = i;
-                /* Look for more occurrences of the same entry.  Match them
-                   as long as they pair up.  Unpaired occurrences of the same
-                   entry are left without mapping.  */
-                {
-                  ssize_t curr_i = i;
-                  ssize_t curr_j = j;
-
-                  for (;;)
-                    {
-                      ssize_t next_i;
-                      ssize_t next_j;
-
-                      next_i =
-                        gl_list_indexof_from (file1->entries_reversed,
-                                              n1 - curr_i, entry);
-                      if (next_i < 0)
-                        break;
-                      next_j =
-                        gl_list_indexof_from (file2->entries_reversed,
-                                              n2 - curr_j, entry);
-                      if (next_j < 0)
-                        break;
-                      curr_i = n1 - 1 - next_i;
-                      curr_j = n2 - 1 - next_j;
-                      ASSERT (index_mapping[curr_i] < 0);
-                      ASSERT (index_mapping_reverse[curr_j] < 0);
-                      index_mapping[curr_i] = curr_j;
-                      index_mapping_reverse[curr_j] = curr_i;
-                    }
-                }
-              }
-          }
-      }
+  struct stat statbuf;
 
-  result->file1 = file1;
-  result->file2 = file2;
-  result->index_mapping = index_mapping;
-  result->index_mapping_reverse = index_mapping_reverse;
-
-  if (full)
-    for (i = n1 - 1; i >= 0; i--)
-      entries_mapping_get (result, i);
+  return (stat (filename, &statbuf) == 0 ? statbuf.st_size : 0);
 }
 
-/* An "edit" is a textual modification performed by the user, that needs to
-   be applied to the other file.  */
-enum edit_type
-{
-  /* Some consecutive entries were added.  */
-  ADDITION,
-  /* Some consecutive entries were removed; some other consecutive entries
-     were added at the same position.  (Not necessarily the same number of
-     entries.)  */
-  CHANGE,
-  /* Some consecutive entries were removed.  */
-  REMOVAL
-};
-
-/* This structure represents an edit.  */
-struct edit
+/* Determine whether a merge is trivial, like changelog_merge_trivial does,
+   but by comparing the files on disk.
+   Return the kind of trivial merge, and the file that is the result in
+   *WINNER.  */
+static enum changelog_merge_trivial
+trivial_merge (const char *ancestor_file_name,
+               const char *mainstream_file_name,
+               const char **modified_file_names, size_t num_modified_files,
+               const char **winner)
 {
-  enum edit_type type;
-  /* Range of indices into the entries of FILE1.  */
-  ssize_t i1, i2;       /* first, last index; only used for CHANGE, REMOVAL */
-  /* Range of indices into the entries of FILE2.  */
-  ssize_t j1, j2;       /* first, last index; only used for ADDITION, CHANGE */
-};
+  size_t m;
 
-/* This structure represents the differences from one file, FILE1, to another
-   file, FILE2.  */
-struct differences
-{
-  /* An array mapping FILE1 indices to FILE2 indices (or -1 when the entry
-     from FILE1 is not found in FILE2).  */
-  ssize_t *index_mapping;
-  /* An array mapping FILE2 indices to FILE1 indices (or -1 when the entry
-     from FILE2 is not found in FILE1).  */
-  ssize_t *index_mapping_reverse;
-  /* The edits that transform FILE1 into FILE2.  */
-  size_t num_edits;
-  struct edit **edits;
-};
+  for (m = 0; m < num_modified_files; m++)
+    if (!files_equal (modified_file_names[m], ancestor_file_name))
+      break;
+  if (m == num_modified_files)
+    {
+      *winner = mainstream_file_name;
+      return CHANGELOG_MERGE_MODIFIED_UNCHANGED;
+    }
 
-/* Import the difference detection algorithm from GNU diff.  */
-#define ELEMENT struct entry *
-#define EQUAL entry_equals
-#define OFFSET ssize_t
-#define EXTRA_CONTEXT_FIELDS \
-  ssize_t *index_mapping; \
-  ssize_t *index_mapping_reverse;
-#define NOTE_DELETE(ctxt, xoff) \
-  ctxt->index_mapping[xoff] = -1
-#define NOTE_INSERT(ctxt, yoff) \
-  ctxt->index_mapping_reverse[yoff] = -1
-#include "diffseq.h"
-
-/* Compute the differences between the entries of FILE1 and the entries of
-   FILE2.  */
-static void
-compute_differences (struct changelog_file *file1, struct changelog_file *file2,
-                     struct differences *result)
-{
-  /* Unlike compute_mapping, which mostly ignores the order of the entries and
-     therefore works well when some entries are permuted, here we use the order.
-     I think this is needed in order to distinguish changes from
-     additions+removals; I don't know how to say what is a "change" if the
-     files are considered as unordered sets of entries.  */
-  struct context ctxt;
-  size_t n1 = file1->num_entries;
-  size_t n2 = file2->num_entries;
-  ssize_t i;
-  ssize_t j;
-  gl_list_t /* <struct edit *> */ edits;
-
-  ctxt.xvec = file1->entries;
-  ctxt.yvec = file2->entries;
-  ctxt.index_mapping = XNMALLOC (n1, ssize_t);
-  for (i = 0; i < n1; i++)
-    ctxt.index_mapping[i] = 0;
-  ctxt.index_mapping_reverse = XNMALLOC (n2, ssize_t);
-  for (j = 0; j < n2; j++)
-    ctxt.index_mapping_reverse[j] = 0;
-  ctxt.fdiag = XNMALLOC (2 * (n1 + n2 + 3), ssize_t) + n2 + 1;
-  ctxt.bdiag = ctxt.fdiag + n1 + n2 + 3;
-  ctxt.too_expensive = n1 + n2;
-
-  /* Store in ctxt.index_mapping and ctxt.index_mapping_reverse a -1 for
-     each removed or added entry.  */
-  compareseq (0, n1, 0, n2, 0, &ctxt);
-
-  /* Complete the index_mapping and index_mapping_reverse arrays.  */
-  i = 0;
-  j = 0;
-  while (i < n1 || j < n2)
+  if (num_modified_files == 1
+      && files_equal (mainstream_file_name, ancestor_file_name))
     {
-      while (i < n1 && ctxt.index_mapping[i] < 0)
-        i++;
-      while (j < n2 && ctxt.index_mapping_reverse[j] < 0)
-        j++;
-      ASSERT ((i < n1) == (j < n2));
-      if (i == n1 && j == n2)
-        break;
-      ctxt.index_mapping[i] = j;
-      ctxt.index_mapping_reverse[j] = i;
-      i++;
-      j++;
+      *winner = modified_file_names[0];
+      return CHANGELOG_MERGE_MAINSTREAM_UNCHANGED;
     }
 
-  /* Create the edits.  */
-  edits = gl_list_create_empty (GL_ARRAY_LIST, NULL, NULL, NULL, true);
-  i = 0;
-  j = 0;
-  while (i < n1 || j < n2)
+  for (m = 0; m < num_modified_files; m++)
+    if (!files_equal (modified_file_names[m], mainstream_file_name))
+      break;
+  if (m == num_modified_files)
     {
-      if (i == n1)
-        {
-          struct edit *e;
-          ASSERT (j < n2);
-          e = XMALLOC (struct edit);
-          e->type = ADDITION;
-          e->j1 = j;
-          e->j2 = n2 - 1;
-          gl_list_add_last (edits, e);
-          break;
-        }
-      if (j == n2)
-        {
-          struct edit *e;
-          ASSERT (i < n1);
-          e = XMALLOC (struct edit);
-          e->type = REMOVAL;
-          e->i1 = i;
-          e->i2 = n1 - 1;
-          gl_list_add_last (edits, e);
-          break;
-        }
-      if (ctxt.index_mapping[i] >= 0)
-        {
-          if (ctxt.index_mapping_reverse[j] >= 0)
-            {
-              ASSERT (ctxt.index_mapping[i] == j);
-              ASSERT (ctxt.index_mapping_reverse[j] == i);
-              i++;
-              j++;
-            }
-          else
-            {
-              struct edit *e;
-              ASSERT (ctxt.index_mapping_reverse[j] < 0);
-              e = XMALLOC (struct edit);
-              e->type = ADDITION;
-              e->j1 = j;
-              do
-                j++;
-              while (j < n2 && ctxt.index_mapping_reverse[j] < 0);
-              e->j2 = j - 1;
-              gl_list_add_last (edits, e);
-            }
-        }
-      else
-        {
-          if (ctxt.index_mapping_reverse[j] >= 0)
-            {
-              struct edit *e;
-              ASSERT (ctxt.index_mapping[i] < 0);
-              e = XMALLOC (struct edit);
-              e->type = REMOVAL;
-              e->i1 = i;
-              do
-                i++;
-              while (i < n1 && ctxt.index_mapping[i] < 0);
-              e->i2 = i - 1;
-              gl_list_add_last (edits, e);
-            }
-          else
-            {
-              struct edit *e;
-              ASSERT (ctxt.index_mapping[i] < 0);
-              ASSERT (ctxt.index_mapping_reverse[j] < 0);
-              e = XMALLOC (struct edit);
-              e->type = CHANGE;
-              e->i1 = i;
-              do
-                i++;
-              while (i < n1 && ctxt.index_mapping[i] < 0);
-              e->i2 = i - 1;
-              e->j1 = j;
-              do
-                j++;
-              while (j < n2 && ctxt.index_mapping_reverse[j] < 0);
-              e->j2 = j - 1;
-              gl_list_add_last (edits, e);
-            }
-        }
+      *winner = mainstream_file_name;
+      return CHANGELOG_MERGE_SAME_CHANGES;
     }
 
-  result->index_mapping = ctxt.index_mapping;
-  result->index_mapping_reverse = ctxt.index_mapping_reverse;
-  result->num_edits = gl_list_size (edits);
-  result->edits = XNMALLOC (result->num_edits, struct edit *);
-  {
-    size_t index = 0;
-    gl_list_iterator_t iter = gl_list_iterator (edits);
-    const void *elt;
-    gl_list_node_t node;
-    while (gl_list_iterator_next (&iter, &elt, &node))
-      result->edits[index++] = (struct edit *) elt;
-    gl_list_iterator_free (&iter);
-    ASSERT (index == result->num_edits);
-  }
+  return CHANGELOG_MERGE_NOT_TRIVIAL;
 }
 
-/* An empty entry.  */
-static struct entry empty_entry = { NULL, 0 };
-
-/* Return the end a paragraph.
-   ENTRY is an entry.
-   OFFSET is an offset into the entry, OFFSET <= ENTRY->length.
-   Return the offset of the end of paragraph, as an offset <= ENTRY->length;
-   it is the start of a blank line or the end of the entry.  */
-static size_t
-find_paragraph_end (const struct entry *entry, size_t offset)
+/* Copy the file SRC_FILENAME to DST_FILENAME.  Where the file system supports
+   it, the copy shares the data blocks with the original.  Exit upon
+   failure.  */
+static void
+copy_changelog_file (const char *src_filename, const char *dst_filename)
 {
-  const char *string = entry->string;
-  size_t length = entry->length;
+  int src_fd;
+  int dst_fd;
 
-  for (;;)
+  src_fd = open (src_filename, O_RDONLY);
+  if (src_fd < 0)
     {
-      const char *nl = memchr (string + offset, '\n', length - offset);
-      if (nl == NULL)
-        return length;
-      offset = (nl - string) + 1;
-      if (offset < length && string[offset] == '\n')
-        return offset;
+      fprintf (stderr, "could not read file '%s'\n", src_filename);
+      exit (EXIT_FAILURE);
+    }
+  dst_fd = open (dst_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (dst_fd < 0)
+    {
+      fprintf (stderr, "could not write file '%s'\n", dst_filename);
+      exit (EXIT_FAILURE);
     }
-}
-
-/* Split a merged entry.
-   Given an old entry of the form
-       TITLE
-       BODY
-   and a new entry of the form
-       TITLE
-       BODY1
-       BODY'
-   where the two titles are the same and BODY and BODY' are very similar,
-   this computes two new entries
-       TITLE
-       BODY1
-   and
-       TITLE
-       BODY'
-   and returns true.
-   If the entries don't have this form, it returns false.  */
-static bool
-try_split_merged_entry (const struct entry *old_entry,
-                        const struct entry *new_entry,
-                        struct entry *new_split[2])
-{
-  size_t old_title_len = find_paragraph_end (old_entry, 0);
-  size_t new_title_len = find_paragraph_end (new_entry, 0);
-  struct entry old_body;
-  struct entry new_body;
-  size_t best_split_offset;
-  double best_similarity;
-  size_t split_offset;
-
-  /* Same title? */
-  if (!(old_title_len == new_title_len
-        && memcmp (old_entry->string, new_entry->string, old_title_len) == 0))
-    return false;
 
-  old_body.string = old_entry->string + old_title_len;
-  old_body.length = old_entry->length - old_title_len;
+#ifdef FICLONE
+  if (ioctl (dst_fd, FICLONE, src_fd) == 0)
+    goto done;
+#endif
 
-  /* Determine where to split the new entry.
-     This is done by maximizing the similarity between BODY and BODY'.  */
-  best_split_offset = split_offset = new_title_len;
-  best_similarity = 0.0;
+#if HAVE_COPY_FILE_RANGE
   for (;;)
     {
-      double similarity;
-
-      new_body.string = new_entry->string + split_offset;
-      new_body.length = new_entry->length - split_offset;
-      similarity =
-        entry_fstrcmp (&old_body, &new_body, best_similarity);
-      if (similarity > best_similarity)
+      ssize_t n = copy_file_range (src_fd, NULL, dst_fd, NULL, 1 << 30, 0);
+      if (n == 0)
+        goto done;
+      if (n < 0)
         {
-          best_split_offset = split_offset;
-          best_similarity = similarity;
+          if (errno == EINTR)
+            continue;
+          /* Not supported between these files.  Copy through a buffer,
+             starting over.  */
+          if (lseek (src_fd, 0, SEEK_SET) < 0
+              || lseek (dst_fd, 0, SEEK_SET) < 0
+              || ftruncate (dst_fd, 0) < 0)
+            goto write_error;
+          break;
         }
-      if (best_similarity == 1.0)
-        /* It cannot get better.  */
-        break;
-
-      if (split_offset < new_entry->length)
-        split_offset = find_paragraph_end (new_entry, split_offset + 1);
-      else
-        break;
     }
+#endif
 
-  /* BODY' should not be empty.  */
-  if (best_split_offset == new_entry->length)
-    return false;
-  ASSERT (new_entry->string[best_split_offset] == '\n');
+  {
+    char buf[16384];
 
-  /* A certain similarity between BODY and BODY' is required.  */
-  if (best_similarity < FSTRCMP_STRICTER_THRESHOLD)
-    return false;
+    for (;;)
+      {
+        ssize_t n = read (src_fd, buf, sizeof (buf));
+        char *p;
+
+        if (n == 0)
+          break;
+        if (n < 0)
+          {
+            if (errno == EINTR)
+              continue;
+            fprintf (stderr, "could not read file '%s'\n", src_filename);
+            exit (EXIT_FAILURE);
+          }
+        for (p = buf; n > 0; )
+          {
+            ssize_t written = write (dst_fd, p, n);
+            if (written < 0)
+              {
+                if (errno == EINTR)
+                  continue;
+                goto write_error;
+              }
+            p += written;
+            n -= written;
+          }
+      }
+  }
 
-  new_split[0] = entry_create (new_entry->string, best_split_offset + 1);
+#if defined FICLONE || HAVE_COPY_FILE_RANGE
+ done:
+#endif
+  close (src_fd);
+  if (close (dst_fd) < 0)
+    goto write_error;
+  return;
+
+ write_error:
+  fprintf (stderr, "error writing to file '%s'\n", dst_filename);
+  exit (EXIT_FAILURE);
+}
 
+/* Descriptions of the values of enum changelog_merge_trivial.  */
+static const char *trivial_names[] =
   {
-    size_t len1 = new_title_len;
-    size_t len2 = new_entry->length - best_split_offset;
-    char *combined = XNMALLOC (len1 + len2, char);
-    memcpy (combined, new_entry->string, len1);
-    memcpy (combined + len1, new_entry->string + best_split_offset, len2);
-    new_split[1] = entry_create (combined, len1 + len2);
-  }
+    "no",
+    "modified unchanged",
+    "mainstream unchanged",
+    "same changes"
+  };
 
-  return true;
+/* Print the statistics about a merge to standard error.  */
+static void
+print_stats (const struct changelog_merge_stats *stats)
+{
+  fprintf (stderr, "trivial: %s\n", trivial_names[stats->trivial]);
+  fprintf (stderr, "entries: %lu ancestor, %lu mainstream, %lu modified\n",
+           (unsigned long) stats->ancestor_entries,
+           (unsigned long) stats->mainstream_entries,
+           (unsigned long) stats->modified_entries);
+  fprintf (stderr, "edits: %lu (%lu additions, %lu removals, %lu changes)\n",
+           (unsigned long) stats->edits,
+           (unsigned long) stats->additions,
+           (unsigned long) stats->removals,
+           (unsigned long) stats->changes);
+  fprintf (stderr, "conflicts: %lu\n", (unsigned long) stats->conflicts);
+  fprintf (stderr, "comparisons: %lu\n", (unsigned long) stats->comparisons);
+  fprintf (stderr, "similarity memo: %lu comparisons avoided, %lu evictions\n",
+           (unsigned long) stats->similarity_avoided,
+           (unsigned long) stats->memo_evictions);
+  fprintf (stderr, "sketches: %lu comparisons avoided\n",
+           (unsigned long) stats->sketch_pruned);
+  fprintf (stderr, "degraded:%s%s%s%s\n",
+           stats->degraded_mapping ? " mapping" : "",
+           stats->degraded_diff ? " diff" : "",
+           stats->degraded_split ? " split" : "",
+           !(stats->degraded_mapping || stats->degraded_diff
+             || stats->degraded_split)
+           ? " none" : "");
 }
 
-/* Write the contents of an entry to the output stream FP.  */
+/* Print the summary of a probe to standard output.  */
 static void
-entry_write (FILE *fp, struct entry *entry)
+print_probe_summary (const struct changelog_merge_result *result)
 {
-  if (entry->length > 0)
-    fwrite (entry->string, 1, entry->length, fp);
+  const struct changelog_merge_stats *stats = &result->stats;
+
+  printf ("%s\n", stats->conflicts > 0 ? "conflict" : "clean");
+  if (stats->trivial != CHANGELOG_MERGE_NOT_TRIVIAL)
+    printf ("trivial: %s\n", trivial_names[stats->trivial]);
+  else
+    printf ("edits: %lu additions, %lu removals, %lu changes\n",
+            (unsigned long) stats->additions,
+            (unsigned long) stats->removals,
+            (unsigned long) stats->changes);
+  if (result->conflict_title != NULL)
+    {
+      printf ("first conflict: ");
+      fwrite (result->conflict_title, 1, result->conflict_title_length,
+              stdout);
+      printf ("\n");
+    }
+  if (fwriteerror (stdout))
+    error (EXIT_FAILURE, errno, "error writing to standard output");
 }
 
-/* This structure represents a conflict.
-   A conflict can occur for various reasons.  */
-struct conflict
+/* Telemetry.
+   With --telemetry=FILE, or when the environment variable
+   GIT_MERGE_CHANGELOG_TELEMETRY is set to FILE, every merge appends a record
+   to FILE.  The record is written with a single write() to a file opened
+   with O_APPEND; therefore concurrent processes don't need any locking, and
+   records don't get interleaved.  The git-merge-changelog-report script
+   summarizes such files.
+
+   Record layout, version 1.  All integers are unsigned and little-endian;
+   times are in microseconds.
+     offset  size
+        0     4   magic "GMCT"
+        4     2   version
+        6     2   size of the record
+        8     8   time of the merge, in seconds since the Epoch
+       16     4   process id
+       20     1   direction that was used: 0 = upstream, 1 = downstream
+       21     1   what determined the requested direction: 0 = GIT_DOWNSTREAM,
+                  1 = GIT_UPSTREAM, 2 = GIT_REFLOG_ACTION, 3 = default
+       22     1   enum changelog_merge_trivial
+       23     1   exit status
+       24     4   number of modified files
+       28     8   size of the ancestor file
+       36     8   size of the mainstream file
+       44     8   total size of the modified files
+       52     4   number of entries of the ancestor file
+       56     4   number of entries of the mainstream file
+       60     4   number of entries of the modified files
+       64     4   number of additions
+       68     4   number of removals
+       72     4   number of changes
+       76     4   number of conflicts
+       80     4   time for reading the files
+       84     4   time for splitting them into entries
+       88     4   time for matching the entries
+       92     4   time for computing the differences
+       96     4   time for applying them
+      100     4   time for assembling the merged file
+      104     4   time for writing it
+      108     4   total time
+      112     8   the first 8 bytes of the SHA-1 of the contents of the files
+      120   */
+
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_RECORD_SIZE 120
+
+/* What determined the pull direction.  */
+enum direction_source
+{
+  DIRECTION_FROM_GIT_DOWNSTREAM,
+  DIRECTION_FROM_GIT_UPSTREAM,
+  DIRECTION_FROM_GIT_REFLOG_ACTION,
+  DIRECTION_DEFAULT
+};
+
+/* The data of a telemetry record.  */
+struct telemetry
 {
-  /* Parts from the ancestor file.  */
-  size_t num_old_entries;
-  struct entry **old_entries;
-  /* Parts of the modified file.  */
-  size_t num_modified_entries;
-  struct entry **modified_entries;
+  struct timespec start;
+  bool downstream;
+  enum direction_source direction_source;
+  size_t num_modified_files;
+  size_t ancestor_size;
+  size_t mainstream_size;
+  size_t modified_size;
+  unsigned long read_time;
+  unsigned long write_time;
+  unsigned char digest[20];
 };
 
-/* Write a conflict to the output stream FP, including markers.  */
+/* Return the time elapsed since START, in microseconds.  */
+static unsigned long
+elapsed_since (const struct timespec *start)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000000L
+         + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+/* Store VALUE in little-endian byte order in P[0..SIZE-1].  */
 static void
-conflict_write (FILE *fp, struct conflict *c)
+put_le (unsigned char *p, size_t size, unsigned long long value)
 {
   size_t i;
 
-  /* Use the same syntax as git's default merge driver.
-     Don't indent the contents of the entries (with things like ">" or "-"),
-     otherwise the user needs more textual editing to resolve the conflict.  */
-  fputs ("<<<<<<<\n", fp);
-  for (i = 0; i < c->num_old_entries; i++)
-    entry_write (fp, c->old_entries[i]);
-  fputs ("=======\n", fp);
-  for (i = 0; i < c->num_modified_entries; i++)
-    entry_write (fp, c->modified_entries[i]);
-  fputs (">>>>>>>\n", fp);
+  for (i = 0; i < size; i++)
+    {
+      p[i] = value & 0xff;
+      value >>= 8;
+    }
+}
+
+/* Append a telemetry record to FILENAME.  Failures are only reported.  */
+static void
+write_telemetry (const char *filename, const struct telemetry *telemetry,
+                 const struct changelog_merge_stats *stats, int exit_status)
+{
+  unsigned char record[TELEMETRY_RECORD_SIZE];
+  int fd;
+  ssize_t written;
+  int saved_errno;
+
+  memset (record, 0, sizeof (record));
+  memcpy (record, "GMCT", 4);
+  put_le (record + 4, 2, TELEMETRY_VERSION);
+  put_le (record + 6, 2, TELEMETRY_RECORD_SIZE);
+  put_le (record + 8, 8, time (NULL));
+  put_le (record + 16, 4, getpid ());
+  record[20] = telemetry->downstream;
+  record[21] = telemetry->direction_source;
+  record[22] = stats->trivial;
+  record[23] = exit_status;
+  put_le (record + 24, 4, telemetry->num_modified_files);
+  put_le (record + 28, 8, telemetry->ancestor_size);
+  put_le (record + 36, 8, telemetry->mainstream_size);
+  put_le (record + 44, 8, telemetry->modified_size);
+  put_le (record + 52, 4, stats->ancestor_entries);
+  put_le (record + 56, 4, stats->mainstream_entries);
+  put_le (record + 60, 4, stats->modified_entries);
+  put_le (record + 64, 4, stats->additions);
+  put_le (record + 68, 4, stats->removals);
+  put_le (record + 72, 4, stats->changes);
+  put_le (record + 76, 4, stats->conflicts);
+  put_le (record + 80, 4, telemetry->read_time);
+  put_le (record + 84, 4, stats->split_time);
+  put_le (record + 88, 4, stats->mapping_time);
+  put_le (record + 92, 4, stats->diff_time);
+  put_le (record + 96, 4, stats->apply_time);
+  put_le (record + 100, 4, stats->output_time);
+  put_le (record + 104, 4, telemetry->write_time);
+  put_le (record + 108, 4, elapsed_since (&telemetry->start));
+  memcpy (record + 112, telemetry->digest, 8);
+
+  fd = open (filename, O_WRONLY | O_APPEND | O_CREAT, 0666);
+  if (fd < 0)
+    {
+      error (0, errno, "could not write telemetry to '%s'", filename);
+      return;
+    }
+  written = write (fd, record, sizeof (record));
+  if (written < 0)
+    saved_errno = errno;
+  else if (written != sizeof (record))
+    /* A short write sets no errno.  */
+    saved_errno = ENOSPC;
+  else
+    saved_errno = 0;
+  if (close (fd) < 0 && saved_errno == 0)
+    saved_errno = errno;
+  if (saved_errno != 0)
+    error (0, saved_errno, "could not write telemetry to '%s'", filename);
 }
 
 /* Long options.  */
 static const struct option long_options[] =
 {
   { "help", no_argument, NULL, 'h' },
+  { "index-cache", required_argument, NULL, CHAR_MAX + 8 },
+  { "probe", no_argument, NULL, CHAR_MAX + 4 },
+  { "record", no_argument, NULL, CHAR_MAX + 6 },
+  { "rerere", required_argument, NULL, CHAR_MAX + 5 },
   { "split-merged-entry", no_argument, NULL, CHAR_MAX + 1 },
+  { "stats", no_argument, NULL, CHAR_MAX + 3 },
+  { "telemetry", required_argument, NULL, CHAR_MAX + 7 },
+  { "time-budget", required_argument, NULL, CHAR_MAX + 2 },
   { "version", no_argument, NULL, 'V' },
   { NULL, 0, NULL, 0 }
 };
@@ -975,7 +700,7 @@ usage (int status)
              program_name);
   else
     {
-      printf ("Usage: %s [OPTION] O-FILE-NAME A-FILE-NAME B-FILE-NAME\n",
+      printf ("Usage: %s [OPTION] O-FILE-NAME A-FILE-NAME B-FILE-NAME...\n",
               program_name);
       printf ("\n");
       printf ("Merges independent modifications of a ChangeLog style file.\n");
@@ -983,6 +708,8 @@ usage (int status)
       printf ("A-FILE-NAME names the publicly modified file.\n");
       printf ("B-FILE-NAME names the user-modified file.\n");
       printf ("Writes the merged file into A-FILE-NAME.\n");
+      printf ("When several B-FILE-NAMEs are given, all of them are merged into\n");
+      printf ("A-FILE-NAME at once, in the given order.\n");
       printf ("\n");
       #if 0 /* --split-merged-entry is now on by default.  */
       printf ("Operation modifiers:\n");
@@ -994,9 +721,34 @@ usage (int status)
                               date.\n");
       printf ("\n");
       #endif
+      printf ("Operation modifiers:\n");
+      printf ("\
+      --time-budget=MS        Spend at most about MS milliseconds on the\n\
+                              fuzzy matching and difference computations;\n\
+                              when the time is up, fall back to exact\n\
+                              matching and coarser conflicts.\n");
+      printf ("\
+      --probe                 Only determine whether the merge is clean:\n\
+                              stop at the first conflict, leave %%A alone,\n\
+                              and print a summary to standard output.\n");
+      printf ("\
+      --rerere=DIR            Resolve the conflicts that were resolved before\n\
+                              and recorded in the cache directory DIR.\n");
+      printf ("\
+      --index-cache=DIR       Keep the entries and sketches of the files in\n\
+                              the cache directory DIR, for later merges.\n");
+      printf ("\n");
+      printf ("Recording resolutions:\n");
+      printf ("\
+      --rerere=DIR --record FILE\n\
+                              Record in DIR the resolutions of the previous\n\
+                              conflicts that have been resolved in FILE.\n");
+      printf ("\n");
       printf ("Informative output:\n");
       printf ("  -h, --help                  display this help and exit\n");
       printf ("  -V, --version               output version information and exit\n");
+      printf ("      --stats                 print statistics to standard error\n");
+      printf ("      --telemetry=FILE        append a binary record about the merge to FILE\n");
       printf ("\n");
       fputs ("Report bugs to <bug-gnulib@gnu.org>.\n",
              stdout);
@@ -1011,7 +763,13 @@ main (int argc, char *argv[])
   int optchar;
   bool do_help;
   bool do_version;
-  bool split_merged_entry;
+  bool do_stats;
+  bool do_record;
+  const char *rerere_dir;
+  const char *index_cache_dir;
+  const char *telemetry_file;
+  struct telemetry telemetry;
+  struct changelog_merge_options options;
 
   /* Set program name for messages.  */
   set_program_name (argv[0]);
@@ -1019,7 +777,16 @@ main (int argc, char *argv[])
   /* Set default values for variables.  */
   do_help = false;
   do_version = false;
-  split_merged_entry = true;
+  do_stats = false;
+  do_record = false;
+  rerere_dir = NULL;
+  index_cache_dir = NULL;
+  telemetry_file = getenv ("GIT_MERGE_CHANGELOG_TELEMETRY");
+  if (telemetry_file != NULL && telemetry_file[0] == '\0')
+    telemetry_file = NULL;
+  memset (&telemetry, 0, sizeof (telemetry));
+  clock_gettime (CLOCK_MONOTONIC, &telemetry.start);
+  changelog_merge_options_init (&options);
 
   /* Parse command line options.  */
   while ((optchar = getopt_long (argc, argv, "hV", long_options, NULL)) != EOF)
@@ -1035,6 +802,32 @@ main (int argc, char *argv[])
       break;
     case CHAR_MAX + 1:  /* --split-merged-entry */
       break;
+    case CHAR_MAX + 2:  /* --time-budget */
+      {
+        char *endp;
+        options.time_budget = strtol (optarg, &endp, 10);
+        if (endp == optarg || *endp != '\0' || options.time_budget < 0)
+          error (EXIT_FAILURE, 0, "invalid time budget: %s", optarg);
+      }
+      break;
+    case CHAR_MAX + 3:  /* --stats */
+      do_stats = true;
+      break;
+    case CHAR_MAX + 4:  /* --probe */
+      options.probe = true;
+      break;
+    case CHAR_MAX + 5:  /* --rerere */
+      rerere_dir = optarg;
+      break;
+    case CHAR_MAX + 6:  /* --record */
+      do_record = true;
+      break;
+    case CHAR_MAX + 7:  /* --telemetry */
+      telemetry_file = optarg;
+      break;
+    case CHAR_MAX + 8:  /* --index-cache */
+      index_cache_dir = optarg;
+      break;
     default:
       usage (EXIT_FAILURE);
     }
@@ -1059,30 +852,55 @@ There is NO WARRANTY, to the extent permitted by law.\n\
       usage (EXIT_SUCCESS);
     }
 
+  if (do_record)
+    {
+      /* Recording the resolutions is requested.  */
+      struct read_job job;
+      int count;
+
+      if (rerere_dir == NULL)
+        error (EXIT_FAILURE, 0, "--record requires --rerere");
+      if (optind + 1 != argc)
+        error (EXIT_FAILURE, 0, "expected one argument");
+      job.filename = argv[optind];
+      job.index_cache = NULL;
+      read_changelog_files (&job, 1);
+      count = changelog_rerere_record (rerere_dir, job.contents, job.length);
+      if (count < 0)
+        error (EXIT_FAILURE, errno, "could not record resolutions in '%s'",
+               rerere_dir);
+      if (do_stats)
+        fprintf (stderr, "recorded: %d\n", count);
+      exit (EXIT_SUCCESS);
+    }
+
   /* Test argument count.  */
-  if (optind + 3 != argc)
-    error (EXIT_FAILURE, 0, "expected three arguments");
+  if (optind + 3 > argc)
+    error (EXIT_FAILURE, 0, "expected at least three arguments");
 
   {
     const char *ancestor_file_name; /* O-FILE-NAME */
     const char *destination_file_name; /* A-FILE-NAME */
     bool downstream;
-    const char *other_file_name; /* B-FILE-NAME */
+    size_t num_other_files;
+    const char **other_file_names; /* B-FILE-NAME... */
     const char *mainstream_file_name;
-    const char *modified_file_name;
-    struct changelog_file ancestor_file;
-    struct changelog_file mainstream_file;
-    struct changelog_file modified_file;
-    /* Mapping from indices in ancestor_file to indices in mainstream_file.  */
-    struct entries_mapping mapping;
-    struct differences diffs;
-    gl_list_node_t *result_entries_pointers; /* array of pointers into result_entries */
-    gl_list_t /* <struct entry *> */ result_entries;
-    gl_list_t /* <struct conflict *> */ result_conflicts;
+    size_t num_modified_files;
+    const char **modified_file_names;
+    struct changelog_buffer ancestor_file;
+    struct changelog_buffer mainstream_file;
+    struct changelog_buffer *modified_files;
+    struct changelog_merge_result result;
+    int status;
+    size_t reused;
+    size_t index_hits;
+    struct timespec write_start;
+    size_t m;
 
     ancestor_file_name = argv[optind];
     destination_file_name = argv[optind + 1];
-    other_file_name = argv[optind + 2];
+    num_other_files = argc - optind - 2;
+    other_file_names = (const char **) argv + optind + 2;
 
     /* Heuristic to determine whether it's a pull in downstream direction
        (e.g. pull from a centralized server) or a pull in upstream direction
@@ -1134,12 +952,18 @@ There is NO WARRANTY, to the extent permitted by law.\n\
 
       var = getenv ("GIT_DOWNSTREAM");
       if (var != NULL && var[0] != '\0')
-        downstream = true;
+        {
+          downstream = true;
+          telemetry.direction_source = DIRECTION_FROM_GIT_DOWNSTREAM;
+        }
       else
         {
           var = getenv ("GIT_UPSTREAM");
           if (var != NULL && var[0] != '\0')
-            downstream = false;
+            {
+              downstream = false;
+              telemetry.direction_source = DIRECTION_FROM_GIT_UPSTREAM;
+            }
           else
             {
               var = getenv ("GIT_REFLOG_ACTION");
@@ -1150,12 +974,17 @@ There is NO WARRANTY, to the extent permitted by law.\n\
                   && ((strncmp (var, "pull", 4) == 0
                        && c_strstr (var, " --rebase") == NULL)
                       || strncmp (var, "merge origin", 12) == 0))
-                downstream = true;
+                {
+                  downstream = true;
+                  telemetry.direction_source =
+                    DIRECTION_FROM_GIT_REFLOG_ACTION;
+                }
               else
                 {
                   /* "git stash apply", "git rebase", "git cherry-pick" and
                      similar.  */
                   downstream = false;
+                  telemetry.direction_source = DIRECTION_DEFAULT;
                 }
             }
         }
@@ -1175,510 +1004,174 @@ There is NO WARRANTY, to the extent permitted by law.\n\
     }
     #endif
 
-    if (downstream)
+    /* When several files are merged into %A at once, %A is the only
+       candidate for the mainstream file.  */
+    if (downstream && num_other_files == 1)
       {
-        mainstream_file_name = other_file_name;
-        modified_file_name = destination_file_name;
+        mainstream_file_name = other_file_names[0];
+        num_modified_files = 1;
+        modified_file_names = &destination_file_name;
       }
     else
       {
         mainstream_file_name = destination_file_name;
-        modified_file_name = other_file_name;
+        num_modified_files = num_other_files;
+        modified_file_names = other_file_names;
       }
+    telemetry.downstream = (mainstream_file_name != destination_file_name);
 
-    /* Read the three files into memory.  */
-    read_changelog_file (ancestor_file_name, &ancestor_file);
-    read_changelog_file (mainstream_file_name, &mainstream_file);
-    read_changelog_file (modified_file_name, &modified_file);
-
-    /* Compute correspondence between the entries of ancestor_file and of
-       mainstream_file.  */
-    compute_mapping (&ancestor_file, &mainstream_file, false, &mapping);
-    (void) entries_mapping_reverse_get; /* avoid gcc "defined but not" warning */
-
-    /* Compute differences between the entries of ancestor_file and of
-       modified_file.  */
-    compute_differences (&ancestor_file, &modified_file, &diffs);
-
-    /* Compute the result.  */
-    result_entries_pointers =
-      XNMALLOC (mainstream_file.num_entries, gl_list_node_t);
-    result_entries =
-      gl_list_create_empty (GL_LINKED_LIST, entry_equals, entry_hashcode,
-                            NULL, true);
+    /* Shortcut: When some of the files are identical, there is nothing to
+       merge.  Copy the winning file into %A, unless it is %A already.  */
     {
-      size_t k;
-      for (k = 0; k < mainstream_file.num_entries; k++)
-        result_entries_pointers[k] =
-          gl_list_add_last (result_entries, mainstream_file.entries[k]);
-    }
-    result_conflicts =
-      gl_list_create_empty (GL_ARRAY_LIST, NULL, NULL, NULL, true);
-    {
-      size_t e;
-      for (e = 0; e < diffs.num_edits; e++)
+      const char *winner;
+      enum changelog_merge_trivial trivial =
+        trivial_merge (ancestor_file_name, mainstream_file_name,
+                       modified_file_names, num_modified_files, &winner);
+
+      if (trivial != CHANGELOG_MERGE_NOT_TRIVIAL)
         {
-          struct edit *edit = diffs.edits[e];
-          switch (edit->type)
+          memset (&result, 0, sizeof (result));
+          result.stats.trivial = trivial;
+          if (telemetry_file != NULL)
             {
-            case ADDITION:
-              if (edit->j1 == 0)
-                {
-                  /* An addition to the top of modified_file.
-                     Apply it to the top of mainstream_file.  */
-                  ssize_t j;
-                  for (j = edit->j2; j >= edit->j1; j--)
-                    {
-                      struct entry *added_entry = modified_file.entries[j];
-                      gl_list_add_first (result_entries, added_entry);
-                    }
-                }
-              else
-                {
-                  ssize_t i_before;
-                  ssize_t i_after;
-                  ssize_t k_before;
-                  ssize_t k_after;
-                  i_before = diffs.index_mapping_reverse[edit->j1 - 1];
-                  ASSERT (i_before >= 0);
-                  i_after = (edit->j2 + 1 == modified_file.num_entries
-                             ? ancestor_file.num_entries
-                             : diffs.index_mapping_reverse[edit->j2 + 1]);
-                  ASSERT (i_after >= 0);
-                  ASSERT (i_after == i_before + 1);
-                  /* An addition between ancestor_file.entries[i_before] and
-                     ancestor_file.entries[i_after].  See whether these two
-                     entries still exist in mainstream_file and are still
-                     consecutive.  */
-                  k_before = entries_mapping_get (&mapping, i_before);
-                  k_after = (i_after == ancestor_file.num_entries
-                             ? mainstream_file.num_entries
-                             : entries_mapping_get (&mapping, i_after));
-                  if (k_before >= 0 && k_after >= 0 && k_after == k_before + 1)
-                    {
-                      /* Yes, the entry before and after are still neighbours
-                         in mainstream_file.  Apply the addition between
-                         them.  */
-                      if (k_after == mainstream_file.num_entries)
-                        {
-                          size_t j;
-                          for (j = edit->j1; j <= edit->j2; j++)
-                            {
-                              struct entry *added_entry = modified_file.entries[j];
-                              gl_list_add_last (result_entries, added_entry);
-                            }
-                        }
-                      else
-                        {
-                          gl_list_node_t node_k_after = result_entries_pointers[k_after];
-                          size_t j;
-                          for (j = edit->j1; j <= edit->j2; j++)
-                            {
-                              struct entry *added_entry = modified_file.entries[j];
-                              gl_list_add_before (result_entries, node_k_after, added_entry);
-                            }
-                        }
-                    }
-                  else
-                    {
-                      /* It's not clear where the additions should be applied.
-                         Let the user decide.  */
-                      struct conflict *c = XMALLOC (struct conflict);
-                      size_t j;
-                      c->num_old_entries = 0;
-                      c->old_entries = NULL;
-                      c->num_modified_entries = edit->j2 - edit->j1 + 1;
-                      c->modified_entries =
-                        XNMALLOC (c->num_modified_entries, struct entry *);
-                      for (j = edit->j1; j <= edit->j2; j++)
-                        c->modified_entries[j - edit->j1] = modified_file.entries[j];
-                      gl_list_add_last (result_conflicts, c);
-                    }
-                }
-              break;
-            case REMOVAL:
-              {
-                /* Apply the removals one by one.  */
-                size_t i;
-                for (i = edit->i1; i <= edit->i2; i++)
-                  {
-                    struct entry *removed_entry = ancestor_file.entries[i];
-                    ssize_t k = entries_mapping_get (&mapping, i);
-                    if (k >= 0
-                        && entry_equals (removed_entry,
-                                         mainstream_file.entries[k]))
-                      {
-                        /* The entry to be removed still exists in
-                           mainstream_file.  Remove it.  */
-                        gl_list_node_set_value (result_entries,
-                                                result_entries_pointers[k],
-                                                &empty_entry);
-                      }
-                    else
-                      {
-                        /* The entry to be removed was already removed or was
-                           modified.  This is a conflict.  */
-                        struct conflict *c = XMALLOC (struct conflict);
-                        c->num_old_entries = 1;
-                        c->old_entries =
-                          XNMALLOC (c->num_old_entries, struct entry *);
-                        c->old_entries[0] = removed_entry;
-                        c->num_modified_entries = 0;
-                        c->modified_entries = NULL;
-                        gl_list_add_last (result_conflicts, c);
-                      }
-                  }
-              }
-              break;
-            case CHANGE:
-              {
-                bool done = false;
-                /* When the user usually merges entries from the same day,
-                   and this edit is at the top of the file:  */
-                if (split_merged_entry && edit->j1 == 0)
-                  {
-                    /* Test whether the change is "simple merged", i.e. whether
-                       it consists of additions, followed by an augmentation of
-                       the first changed entry, followed by small changes of the
-                       remaining entries:
-                         entry_1
-                         entry_2
-                         ...
-                         entry_n
-                       are mapped to
-                         added_entry
-                         ...
-                         added_entry
-                         augmented_entry_1
-                         modified_entry_2
-                         ...
-                         modified_entry_n.  */
-                    if (edit->i2 - edit->i1 <= edit->j2 - edit->j1)
-                      {
-                        struct entry *split[2];
-                        bool simple_merged =
-                          try_split_merged_entry (ancestor_file.entries[edit->i1],
-                                                  modified_file.entries[edit->i1 + edit->j2 - edit->i2],
-                                                  split);
-                        if (simple_merged)
-                          {
-                            size_t i;
-                            for (i = edit->i1 + 1; i <= edit->i2; i++)
-                              if (entry_fstrcmp (ancestor_file.entries[i],
-                                                 modified_file.entries[i + edit->j2 - edit->i2],
-                                                 FSTRCMP_THRESHOLD)
-                                  < FSTRCMP_THRESHOLD)
-                                {
-                                  simple_merged = false;
-                                  break;
-                                }
-                          }
-                        if (simple_merged)
-                          {
-                            /* Apply the additions at the top of modified_file.
-                               Apply each of the single-entry changes
-                               separately.  */
-                            size_t num_changed = edit->i2 - edit->i1 + 1; /* > 0 */
-                            size_t num_added = (edit->j2 - edit->j1 + 1) - num_changed;
-                            ssize_t j;
-                            /* First part of the split modified_file.entries[edit->j2 - edit->i2 + edit->i1]:  */
-                            gl_list_add_first (result_entries, split[0]);
-                            /* The additions.  */
-                            for (j = edit->j1 + num_added - 1; j >= edit->j1; j--)
-                              {
-                                struct entry *added_entry = modified_file.entries[j];
-                                gl_list_add_first (result_entries, added_entry);
-                              }
-                            /* Now the single-entry changes.  */
-                            for (j = edit->j1 + num_added; j <= edit->j2; j++)
-                              {
-                                struct entry *changed_entry =
-                                  (j == edit->j1 + num_added
-                                   ? split[1]
-                                   : modified_file.entries[j]);
-                                size_t i = j + edit->i2 - edit->j2;
-                                ssize_t k = entries_mapping_get (&mapping, i);
-                                if (k >= 0
-                                    && entry_equals (ancestor_file.entries[i],
-                                                     mainstream_file.entries[k]))
-                                  {
-                                    gl_list_node_set_value (result_entries,
-                                                            result_entries_pointers[k],
-                                                            changed_entry);
-                                  }
-                                else if (!entry_equals (ancestor_file.entries[i],
-                                                        changed_entry))
-                                  {
-                                    struct conflict *c = XMALLOC (struct conflict);
-                                    c->num_old_entries = 1;
-                                    c->old_entries =
-                                      XNMALLOC (c->num_old_entries, struct entry *);
-                                    c->old_entries[0] = ancestor_file.entries[i];
-                                    c->num_modified_entries = 1;
-                                    c->modified_entries =
-                                      XNMALLOC (c->num_modified_entries, struct entry *);
-                                    c->modified_entries[0] = changed_entry;
-                                    gl_list_add_last (result_conflicts, c);
-                                  }
-                              }
-                            done = true;
-                          }
-                      }
-                  }
-                if (!done)
-                  {
-                    bool simple;
-                    /* Test whether the change is "simple", i.e. whether it
-                       consists of small changes to the old ChangeLog entries
-                       and additions before them:
-                         entry_1
-                         ...
-                         entry_n
-                       are mapped to
-                         added_entry
-                         ...
-                         added_entry
-                         modified_entry_1
-                         ...
-                         modified_entry_n.  */
-                    if (edit->i2 - edit->i1 <= edit->j2 - edit->j1)
-                      {
-                        size_t i;
-                        simple = true;
-                        for (i = edit->i1; i <= edit->i2; i++)
-                          if (entry_fstrcmp (ancestor_file.entries[i],
-                                             modified_file.entries[i + edit->j2 - edit->i2],
-                                             FSTRCMP_THRESHOLD)
-                              < FSTRCMP_THRESHOLD)
-                            {
-                              simple = false;
-                              break;
-                            }
-                      }
-                    else
-                      simple = false;
-                    if (simple)
-                      {
-                        /* Apply the additions and each of the single-entry
-                           changes separately.  */
-                        size_t num_changed = edit->i2 - edit->i1 + 1; /* > 0 */
-                        size_t num_added = (edit->j2 - edit->j1 + 1) - num_changed;
-                        if (edit->j1 == 0)
-                          {
-                            /* A simple change at the top of modified_file.
-                               Apply it to the top of mainstream_file.  */
-                            ssize_t j;
-                            for (j = edit->j1 + num_added - 1; j >= edit->j1; j--)
-                              {
-                                struct entry *added_entry = modified_file.entries[j];
-                                gl_list_add_first (result_entries, added_entry);
-                              }
-                            for (j = edit->j1 + num_added; j <= edit->j2; j++)
-                              {
-                                struct entry *changed_entry = modified_file.entries[j];
-                                size_t i = j + edit->i2 - edit->j2;
-                                ssize_t k = entries_mapping_get (&mapping, i);
-                                if (k >= 0
-                                    && entry_equals (ancestor_file.entries[i],
-                                                     mainstream_file.entries[k]))
-                                  {
-                                    gl_list_node_set_value (result_entries,
-                                                            result_entries_pointers[k],
-                                                            changed_entry);
-                                  }
-                                else
-                                  {
-                                    struct conflict *c;
-                                    ASSERT (!entry_equals (ancestor_file.entries[i],
-                                                           changed_entry));
-                                    c = XMALLOC (struct conflict);
-                                    c->num_old_entries = 1;
-                                    c->old_entries =
-                                      XNMALLOC (c->num_old_entries, struct entry *);
-                                    c->old_entries[0] = ancestor_file.entries[i];
-                                    c->num_modified_entries = 1;
-                                    c->modified_entries =
-                                      XNMALLOC (c->num_modified_entries, struct entry *);
-                                    c->modified_entries[0] = changed_entry;
-                                    gl_list_add_last (result_conflicts, c);
-                                  }
-                              }
-                            done = true;
-                          }
-                        else
-                          {
-                            ssize_t i_before;
-                            ssize_t k_before;
-                            bool linear;
-                            i_before = diffs.index_mapping_reverse[edit->j1 - 1];
-                            ASSERT (i_before >= 0);
-                            /* A simple change after ancestor_file.entries[i_before].
-                               See whether this entry and the following num_changed
-                               entries still exist in mainstream_file and are still
-                               consecutive.  */
-                            k_before = entries_mapping_get (&mapping, i_before);
-                            linear = (k_before >= 0);
-                            if (linear)
-                              {
-                                size_t i;
-                                for (i = i_before + 1; i <= i_before + num_changed; i++)
-                                  if (entries_mapping_get (&mapping, i) != k_before + (i - i_before))
-                                    {
-                                      linear = false;
-                                      break;
-                                    }
-                              }
-                            if (linear)
-                              {
-                                gl_list_node_t node_for_insert =
-                                  result_entries_pointers[k_before + 1];
-                                ssize_t j;
-                                for (j = edit->j1 + num_added - 1; j >= edit->j1; j--)
-                                  {
-                                    struct entry *added_entry = modified_file.entries[j];
-                                    gl_list_add_before (result_entries, node_for_insert, added_entry);
-                                  }
-                                for (j = edit->j1 + num_added; j <= edit->j2; j++)
-                                  {
-                                    struct entry *changed_entry = modified_file.entries[j];
-                                    size_t i = j + edit->i2 - edit->j2;
-                                    ssize_t k = entries_mapping_get (&mapping, i);
-                                    ASSERT (k >= 0);
-                                    if (entry_equals (ancestor_file.entries[i],
-                                                      mainstream_file.entries[k]))
-                                      {
-                                        gl_list_node_set_value (result_entries,
-                                                                result_entries_pointers[k],
-                                                                changed_entry);
-                                      }
-                                    else
-                                      {
-                                        struct conflict *c;
-                                        ASSERT (!entry_equals (ancestor_file.entries[i],
-                                                               changed_entry));
-                                        c = XMALLOC (struct conflict);
-                                        c->num_old_entries = 1;
-                                        c->old_entries =
-                                          XNMALLOC (c->num_old_entries, struct entry *);
-                                        c->old_entries[0] = ancestor_file.entries[i];
-                                        c->num_modified_entries = 1;
-                                        c->modified_entries =
-                                          XNMALLOC (c->num_modified_entries, struct entry *);
-                                        c->modified_entries[0] = changed_entry;
-                                        gl_list_add_last (result_conflicts, c);
-                                      }
-                                  }
-                                done = true;
-                              }
-                          }
-                      }
-                    else
-                      {
-                        /* A big change.
-                           See whether the num_changed entries still exist
-                           unchanged in mainstream_file and are still
-                           consecutive.  */
-                        ssize_t i_first;
-                        ssize_t k_first;
-                        bool linear_unchanged;
-                        i_first = edit->i1;
-                        k_first = entries_mapping_get (&mapping, i_first);
-                        linear_unchanged =
-                          (k_first >= 0
-                           && entry_equals (ancestor_file.entries[i_first],
-                                            mainstream_file.entries[k_first]));
-                        if (linear_unchanged)
-                          {
-                            size_t i;
-                            for (i = i_first + 1; i <= edit->i2; i++)
-                              if (!(entries_mapping_get (&mapping, i) == k_first + (i - i_first)
-                                    && entry_equals (ancestor_file.entries[i],
-                                                     mainstream_file.entries[entries_mapping_get (&mapping, i)])))
-                                {
-                                  linear_unchanged = false;
-                                  break;
-                                }
-                          }
-                        if (linear_unchanged)
-                          {
-                            gl_list_node_t node_for_insert =
-                              result_entries_pointers[k_first];
-                            ssize_t j;
-                            size_t i;
-                            for (j = edit->j2; j >= edit->j1; j--)
-                              {
-                                struct entry *new_entry = modified_file.entries[j];
-                                gl_list_add_before (result_entries, node_for_insert, new_entry);
-                              }
-                            for (i = edit->i1; i <= edit->i2; i++)
-                              {
-                                ssize_t k = entries_mapping_get (&mapping, i);
-                                ASSERT (k >= 0);
-                                ASSERT (entry_equals (ancestor_file.entries[i],
-                                                      mainstream_file.entries[k]));
-                                gl_list_node_set_value (result_entries,
-                                                        result_entries_pointers[k],
-                                                        &empty_entry);
-                              }
-                            done = true;
-                          }
-                      }
-                  }
-                if (!done)
-                  {
-                    struct conflict *c = XMALLOC (struct conflict);
-                    size_t i, j;
-                    c->num_old_entries = edit->i2 - edit->i1 + 1;
-                    c->old_entries =
-                      XNMALLOC (c->num_old_entries, struct entry *);
-                    for (i = edit->i1; i <= edit->i2; i++)
-                      c->old_entries[i - edit->i1] = ancestor_file.entries[i];
-                    c->num_modified_entries = edit->j2 - edit->j1 + 1;
-                    c->modified_entries =
-                      XNMALLOC (c->num_modified_entries, struct entry *);
-                    for (j = edit->j1; j <= edit->j2; j++)
-                      c->modified_entries[j - edit->j1] = modified_file.entries[j];
-                    gl_list_add_last (result_conflicts, c);
-                  }
-              }
-              break;
+              /* The files are not read, so there is no digest.  Take the
+                 sizes before %A is overwritten.  */
+              telemetry.num_modified_files = num_modified_files;
+              telemetry.ancestor_size = file_size (ancestor_file_name);
+              telemetry.mainstream_size = file_size (mainstream_file_name);
+              for (m = 0; m < num_modified_files; m++)
+                telemetry.modified_size += file_size (modified_file_names[m]);
             }
+          if (options.probe)
+            print_probe_summary (&result);
+          else if (winner != destination_file_name
+                   && !files_equal (winner, destination_file_name))
+            copy_changelog_file (winner, destination_file_name);
+          if (do_stats)
+            print_stats (&result.stats);
+          if (telemetry_file != NULL)
+            write_telemetry (telemetry_file, &telemetry, &result.stats,
+                             EXIT_SUCCESS);
+          exit (EXIT_SUCCESS);
         }
     }
 
-    /* Output the result.  */
+    /* Read the files into memory.  */
     {
-      FILE *fp = fopen (destination_file_name, "w");
-      if (fp == NULL)
+      size_t num_jobs = 2 + num_modified_files;
+      struct read_job *jobs = XNMALLOC (num_jobs, struct read_job);
+
+      size_t j;
+
+      jobs[0].filename = ancestor_file_name;
+      jobs[1].filename = mainstream_file_name;
+      for (m = 0; m < num_modified_files; m++)
+        jobs[2 + m].filename = modified_file_names[m];
+      for (j = 0; j < num_jobs; j++)
+        jobs[j].index_cache = index_cache_dir;
+      read_changelog_files (jobs, num_jobs);
+      telemetry.read_time = elapsed_since (&telemetry.start);
+
+      ancestor_file.contents = jobs[0].contents;
+      ancestor_file.length = jobs[0].length;
+      ancestor_file.index = (jobs[0].have_index ? &jobs[0].index.index : NULL);
+      mainstream_file.contents = jobs[1].contents;
+      mainstream_file.length = jobs[1].length;
+      mainstream_file.index = (jobs[1].have_index ? &jobs[1].index.index : NULL);
+      modified_files = XNMALLOC (num_modified_files, struct changelog_buffer);
+      for (m = 0; m < num_modified_files; m++)
         {
-          fprintf (stderr, "could not write file '%s'\n", destination_file_name);
-          exit (EXIT_FAILURE);
+          struct read_job *job = &jobs[2 + m];
+          modified_files[m].contents = job->contents;
+          modified_files[m].length = job->length;
+          modified_files[m].index = (job->have_index ? &job->index.index : NULL);
         }
+      index_hits = 0;
+      for (j = 0; j < num_jobs; j++)
+        index_hits += (jobs[j].have_index && jobs[j].index.hit);
+      /* JOBS holds the indexes, which stay in use until the program
+         exits.  */
+    }
 
-      /* Output the conflicts at the top.  */
+    if (telemetry_file != NULL)
       {
-        size_t n = gl_list_size (result_conflicts);
-        size_t i;
-        for (i = 0; i < n; i++)
-          conflict_write (fp, (struct conflict *) gl_list_get_at (result_conflicts, i));
+        struct sha1_ctx sha1;
+
+        telemetry.num_modified_files = num_modified_files;
+        telemetry.ancestor_size = ancestor_file.length;
+        telemetry.mainstream_size = mainstream_file.length;
+        sha1_init_ctx (&sha1);
+        sha1_process_bytes (ancestor_file.contents, ancestor_file.length,
+                            &sha1);
+        sha1_process_bytes (mainstream_file.contents, mainstream_file.length,
+                            &sha1);
+        for (m = 0; m < num_modified_files; m++)
+          {
+            telemetry.modified_size += modified_files[m].length;
+            sha1_process_bytes (modified_files[m].contents,
+                                modified_files[m].length, &sha1);
+          }
+        sha1_finish_ctx (&sha1, telemetry.digest);
       }
-      /* Output the modified and unmodified entries, in order.  */
+
+    /* Merge.  */
+    status = changelog_merge (&ancestor_file, &mainstream_file,
+                              modified_files, num_modified_files,
+                              &options, &result);
+    if (status < 0)
+      error (EXIT_FAILURE, errno, "could not merge");
+
+    /* Reuse the recorded resolutions.  */
+    reused = 0;
+    if (rerere_dir != NULL && status > 0 && !options.probe)
       {
-        gl_list_iterator_t iter = gl_list_iterator (result_entries);
-        const void *elt;
-        gl_list_node_t node;
-        while (gl_list_iterator_next (&iter, &elt, &node))
-          entry_write (fp, (struct entry *) elt);
-        gl_list_iterator_free (&iter);
+        reused = changelog_rerere_apply (rerere_dir, &result);
+        status = (result.stats.conflicts > 0 ? 1 : 0);
       }
 
-      if (fwriteerror (fp))
-        {
-          fprintf (stderr, "error writing to file '%s'\n", destination_file_name);
-          exit (EXIT_FAILURE);
-        }
-    }
+    /* Output the result.  */
+    clock_gettime (CLOCK_MONOTONIC, &write_start);
+    if (options.probe)
+      print_probe_summary (&result);
+    else
+      {
+        FILE *fp = fopen (destination_file_name, "w");
+        if (fp == NULL)
+          {
+            fprintf (stderr, "could not write file '%s'\n",
+                     destination_file_name);
+            exit (EXIT_FAILURE);
+          }
+
+        if (result.length > 0)
+          fwrite (result.contents, 1, result.length, fp);
+
+        if (fwriteerror (fp))
+          {
+            fprintf (stderr, "error writing to file '%s'\n",
+                     destination_file_name);
+            exit (EXIT_FAILURE);
+          }
+      }
+
+    telemetry.write_time = elapsed_since (&write_start);
+
+    if (do_stats)
+      {
+        print_stats (&result.stats);
+        if (rerere_dir != NULL)
+          fprintf (stderr, "reused resolutions: %lu\n",
+                   (unsigned long) reused);
+        if (index_cache_dir != NULL)
+          fprintf (stderr, "index cache: %lu of %lu files\n",
+                   (unsigned long) index_hits,
+                   (unsigned long) (2 + num_modified_files));
+      }
+
+    if (telemetry_file != NULL)
+      write_telemetry (telemetry_file, &telemetry, &result.stats,
+                       status > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
 
-    exit (gl_list_size (result_conflicts) > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    exit (status > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
   }
 }